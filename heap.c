@@ -35,9 +35,12 @@ heap_init(
 	heap->arr = NULL;
 	heap->used = 0;
 	heap->size = 0;
+	heap->keep_size = false;
 
 	heap->temp = alloc_malloc(heap->temp, heap->el_size);
 	assert_not_null(heap->temp);
+
+	heap->allocs = 1;
 }
 
 
@@ -63,7 +66,7 @@ heap_resize(
 
 	uint32_t new_used = heap->used + count;
 
-	if(new_used > heap->size || new_used < heap->size / 4)
+	if(new_used > heap->size || (!heap->keep_size && new_used < heap->size / 4))
 	{
 		uint32_t new_count = new_used > 0 ? new_used << 1 : 4;
 
@@ -71,6 +74,7 @@ heap_resize(
 		assert_not_null(heap->arr);
 
 		heap->size = new_count;
+		++heap->allocs;
 	}
 }
 
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 
 typedef int
@@ -33,7 +34,9 @@ typedef struct heap
 	uint32_t used;
 	uint32_t size;
 	uint32_t el_size;
+	uint32_t allocs;
 	heap_cmp_fn_t cmp_fn;
+	bool keep_size;
 }
 heap_t;
 
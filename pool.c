@@ -0,0 +1,164 @@
+/*
+ *   Copyright 2026 Franciszek Balcerak
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "pool.h"
+#include "alloc/include/alloc/base.h"
+#include "alloc/include/alloc/debug.h"
+
+
+void*
+pool_thread_fn(
+	void* data
+	)
+{
+	pool_thread_t* thread = data;
+	pool_t* pool = thread->pool;
+
+	uint32_t generation = 0;
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while(1)
+	{
+		while(pool->generation == generation && !pool->stop)
+		{
+			pthread_cond_wait(&pool->start_cond, &pool->mutex);
+		}
+
+		if(pool->stop)
+		{
+			break;
+		}
+
+		generation = pool->generation;
+
+		pthread_mutex_unlock(&pool->mutex);
+
+		pool->fn(pool->data, thread->idx);
+
+		pthread_mutex_lock(&pool->mutex);
+
+		if(!--pool->pending)
+		{
+			pthread_cond_signal(&pool->done_cond);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+
+void
+pool_init(
+	pool_t* pool
+	)
+{
+	assert_not_null(pool);
+	assert_gt(pool->thread_count, 0);
+
+	pool->generation = 0;
+	pool->pending = 0;
+	pool->stop = false;
+
+	int status = pthread_mutex_init(&pool->mutex, NULL);
+	hard_assert_eq(status, 0);
+
+	status = pthread_cond_init(&pool->start_cond, NULL);
+	hard_assert_eq(status, 0);
+
+	status = pthread_cond_init(&pool->done_cond, NULL);
+	hard_assert_eq(status, 0);
+
+	pool->threads = alloc_malloc(pool->threads, pool->thread_count);
+	assert_ptr(pool->threads, pool->thread_count);
+
+	for(uint32_t i = 1; i < pool->thread_count; ++i)
+	{
+		pool_thread_t* thread = pool->threads + i;
+
+		thread->pool = pool;
+		thread->idx = i;
+
+		status = pthread_create(&thread->thread, NULL, pool_thread_fn, thread);
+		hard_assert_eq(status, 0);
+	}
+}
+
+
+void
+pool_free(
+	pool_t* pool
+	)
+{
+	assert_not_null(pool);
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for(uint32_t i = 1; i < pool->thread_count; ++i)
+	{
+		pthread_join(pool->threads[i].thread, NULL);
+	}
+
+	alloc_free(pool->threads, pool->thread_count);
+
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_cond_destroy(&pool->start_cond);
+	pthread_mutex_destroy(&pool->mutex);
+}
+
+
+void
+pool_run(
+	pool_t* pool,
+	pool_fn_t fn,
+	void* data
+	)
+{
+	assert_not_null(pool);
+	assert_not_null(fn);
+
+	if(pool->thread_count <= 1)
+	{
+		fn(data, 0);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+
+	pool->fn = fn;
+	pool->data = data;
+	pool->pending = pool->thread_count - 1;
+	++pool->generation;
+
+	pthread_cond_broadcast(&pool->start_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	fn(data, 0);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while(pool->pending)
+	{
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,77 @@
+/*
+ *   Copyright 2026 Franciszek Balcerak
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+
+
+typedef void
+(*pool_fn_t)(
+	void* data,
+	uint32_t thread_idx
+	);
+
+
+typedef struct pool pool_t;
+
+
+typedef struct pool_thread
+{
+	pthread_t thread;
+	pool_t* pool;
+	uint32_t idx;
+}
+pool_thread_t;
+
+
+struct pool
+{
+	uint32_t thread_count;
+	pool_thread_t* threads;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t start_cond;
+	pthread_cond_t done_cond;
+
+	pool_fn_t fn;
+	void* data;
+
+	uint32_t generation;
+	uint32_t pending;
+	bool stop;
+};
+
+
+extern void
+pool_init(
+	pool_t* pool
+	);
+
+
+extern void
+pool_free(
+	pool_t* pool
+	);
+
+
+extern void
+pool_run(
+	pool_t* pool,
+	pool_fn_t fn,
+	void* data
+	);
@@ -20,8 +20,113 @@
 #include "alloc/include/alloc/debug.h"
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if QUADTREE_SIMD_COLLIDE == 1
+	#include <immintrin.h>
+
+	#ifdef __AVX512F__
+		#define QUADTREE_SIMD_WIDTH 16
+	#else
+		#define QUADTREE_SIMD_WIDTH 8
+	#endif
+
+	#define QUADTREE_SIMD_MIN_COUNT 8
+#endif
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	#define QUADTREE_NODE_DIRTY 0b10000
+	#define QUADTREE_ENTITY_FREE UINT32_MAX
+#endif
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+	uint64_t quadtree_heap_calls;
+
+	#define quadtree_heap_call(call)	\
+	(__atomic_add_fetch(&quadtree_heap_calls, 1, __ATOMIC_RELAXED), (call))
+#else
+	#define quadtree_heap_call(call)	\
+	(call)
+#endif
+
+#define QUADTREE_UPDATE_BATCH_SIZE 64
+#define QUADTREE_QUERY_BATCH_SIZE 64
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+	#define QUADTREE_NODE_BLOCK 5
+#else
+	#define QUADTREE_NODE_BLOCK 4
+#endif
+
+#if QUADTREE_ENTITY_SOA == 1
+	#define quadtree_entity_extent(qt, entity, entity_idx)	\
+	((void) (entity), (qt)->entity_extents[entity_idx])
+
+	#define quadtree_entity_payload(qt, entity)	\
+	((qt)->entity_data + (entity)->handle_idx)
+
+	#define quadtree_sync_entity_extent(qt, entity, entity_idx)	\
+	do	\
+	{	\
+		if((entity)->status == QUADTREE_STATUS_CHANGED)	\
+		{	\
+			(qt)->entity_extents[entity_idx] =	\
+				quadtree_get_entity_data_rect_extent(*quadtree_entity_payload(qt, entity));	\
+		}	\
+	}	\
+	while(0)
+#else
+	#define quadtree_entity_extent(qt, entity, entity_idx)	\
+	quadtree_get_entity_rect_extent(entity)
+
+	#define quadtree_entity_payload(qt, entity)	\
+	(&(entity)->data)
+
+	#define quadtree_sync_entity_extent(qt, entity, entity_idx)
+#endif
+
+#if QUADTREE_NODE_ENTITY_EXTENT == 1
+	#define quadtree_node_entity_extent(qt, node_entity)	\
+	((void) (qt), (node_entity)->extent)
+
+	#define quadtree_set_node_entity_extent(node_entity, value, node_extent)	\
+	((node_entity)->extent = (value))
+#else
+	#define quadtree_node_entity_extent(qt, node_entity)	\
+	quadtree_entity_extent(qt, (qt)->entities + (node_entity)->index, (node_entity)->index)
+
+	#if QUADTREE_NODE_ENTITY_EXTENT == 2
+		#define quadtree_set_node_entity_extent(node_entity, value, node_extent)	\
+		((node_entity)->extent = quadtree_quantize_extent(value, node_extent))
+	#else
+		#define quadtree_set_node_entity_extent(node_entity, value, node_extent)
+	#endif
+#endif
+
+#if QUADTREE_NODE_ENTITY_EXTENT != 0
+	#define quadtree_copy_node_entity_extent(node_entity, other_node_entity)	\
+	((node_entity)->extent = (other_node_entity)->extent)
+#else
+	#define quadtree_copy_node_entity_extent(node_entity, other_node_entity)
+#endif
+
+#if QUADTREE_NODE_ENTITY_EXTENT == 2
+	#define quadtree_node_entity_may_intersect(node_entity, quantized)	\
+	quadtree_quantized_intersects((node_entity)->extent, quantized)
+#else
+	#define quadtree_node_entity_may_intersect(node_entity, quantized)	\
+	true
+#endif
+
+#if QUADTREE_LOOSE == 1
+	#define quadtree_get_entity_tree_extent(qt, entity, entity_idx)	\
+	((entity)->loose_extent)
+#else
+	#define quadtree_get_entity_tree_extent(qt, entity, entity_idx)	\
+	quadtree_entity_extent(qt, entity, entity_idx)
+#endif
+
 
 void
 quadtree_init(
@@ -47,14 +152,40 @@ quadtree_init(
 		qt->max_depth = 30;
 	}
 
-	qt->dfs_length = qt->max_depth * 3 + 1;
+	qt->dfs_length = qt->max_depth * (QUADTREE_NODE_BLOCK - 1) + 1;
 
 	if(!qt->min_size)
 	{
 		qt->min_size = 1.0f;
 	}
 
-	qt->nodes = alloc_malloc(qt->nodes, 1);
+#if QUADTREE_LOOSE == 1
+	/* Keeping nodes through updates is what saves reinsertions, a wider margin mostly adds nodes */
+	if(!qt->looseness)
+	{
+		qt->looseness = 0.0625f;
+	}
+#endif
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+	if(!qt->branch_entity_size)
+	{
+		qt->branch_entity_size = 1.0f;
+	}
+#endif
+
+	if(!qt->thread_count)
+	{
+		qt->thread_count = 1;
+	}
+
+	qt->threads = quadtree_heap_call(alloc_calloc(qt->threads, qt->thread_count));
+	assert_ptr(qt->threads, qt->thread_count);
+
+	qt->pool.thread_count = qt->thread_count;
+	pool_init(&qt->pool);
+
+	qt->nodes = quadtree_heap_call(alloc_malloc(qt->nodes, 1));
 	assert_ptr(qt->nodes, 1);
 
 	qt->nodes_used = 1;
@@ -64,10 +195,19 @@ quadtree_init(
 
 	qt->entities_used = 1;
 
+	qt->handles_used = 1;
+
 #if QUADTREE_DEDUPE_COLLISIONS == 1
 	qt->ht_entries_used = 1;
 #endif
 
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	qt->node_parents = quadtree_heap_call(alloc_malloc(qt->node_parents, 1));
+	assert_ptr(qt->node_parents, 1);
+
+	qt->node_parents[0] = 0;
+#endif
+
 	qt->nodes[0].head = 0;
 	qt->nodes[0].position_flags = 0b1111; /* TRBL */
 	qt->nodes[0].count = 0;
@@ -82,14 +222,81 @@ quadtree_free(
 {
 	assert_not_null(qt);
 
+	pool_free(&qt->pool);
+
+	for(uint32_t i = 0; i < qt->thread_count; ++i)
+	{
+		quadtree_thread_t* thread = qt->threads + i;
+
+#if QUADTREE_SIMD_COLLIDE == 1
+		alloc_free(thread->extents, thread->extents_size);
+#endif
+		alloc_free(thread->collisions, thread->collisions_size);
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+		alloc_free(thread->ht_entries, thread->ht_entries_size);
+#if QUADTREE_SCRATCH_ARENAS == 1
+		alloc_free(thread->ht_buckets, thread->ht_buckets_size);
+#endif
+#endif
+		alloc_free(thread->stale_nodes, thread->stale_nodes_size);
+		alloc_free(thread->update_deferrals, thread->update_deferrals_size);
+		alloc_free(thread->node_removals, thread->node_removals_size);
+		alloc_free(thread->reinsertions, thread->reinsertions_size);
+		quadtree_query_scratch_free(&thread->query_scratch);
+	}
+
+	alloc_free(qt->threads, qt->thread_count);
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+	alloc_free(qt->changes, qt->changes_size);
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	alloc_free(qt->ht_buckets, qt->ht_buckets_size);
+#endif
+	alloc_free(qt->entity_map, qt->entity_map_size);
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	alloc_free(qt->gathered_flags, qt->gathered_size);
+	alloc_free(qt->gathered_entities, qt->gathered_size);
+	alloc_free(qt->spare_node_parents, qt->spare_nodes_size);
+#endif
+#if QUADTREE_ENTITY_SOA == 1
+	alloc_free(qt->spare_entity_extents, qt->spare_entities_size);
+#endif
+	alloc_free(qt->spare_entities, qt->spare_entities_size);
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	alloc_free(qt->spare_node_entities.links, qt->spare_node_entities_size);
+#endif
+	alloc_free(qt->spare_node_entities.flags, qt->spare_node_entities_size);
+	alloc_free(qt->spare_node_entities.entities, qt->spare_node_entities_size);
+	alloc_free(qt->spare_node_entities.next, qt->spare_node_entities_size);
+	alloc_free(qt->spare_nodes, qt->spare_nodes_size);
+#endif
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	alloc_free(qt->dirty_nodes, qt->dirty_nodes_size);
+	alloc_free(qt->node_parents, qt->nodes_size);
+#endif
+#ifdef quadtree_node_aggregate
+	alloc_free(qt->node_aggregates, qt->node_aggregates_size);
+#endif
+	alloc_free(qt->stale_nodes, qt->stale_nodes_size);
+	alloc_free(qt->node_counts, qt->node_counts_size);
+	alloc_free(qt->handles, qt->handles_size);
+	quadtree_query_scratch_free(&qt->query_scratch);
 	alloc_free(qt->reinsertions, qt->reinsertions_size);
 	alloc_free(qt->insertions, qt->insertions_size);
 	alloc_free(qt->node_removals, qt->node_removals_size);
 	alloc_free(qt->removals, qt->removals_size);
 #if QUADTREE_DEDUPE_COLLISIONS == 1
 	alloc_free(qt->ht_entries, qt->ht_entries_size);
+#endif
+#if QUADTREE_ENTITY_SOA == 1
+	alloc_free(qt->entity_data, qt->handles_size);
+	alloc_free(qt->entity_extents, qt->entities_size);
 #endif
 	alloc_free(qt->entities, qt->entities_size);
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	alloc_free(qt->node_entities.links, qt->node_entities_size);
+#endif
 	alloc_free(qt->node_entities.flags, qt->node_entities_size);
 	alloc_free(qt->node_entities.entities, qt->node_entities_size);
 	alloc_free(qt->node_entities.next, qt->node_entities_size);
@@ -118,7 +325,7 @@ do													\
 		if(_extent.min_y <= info.extent.y)			\
 		{											\
 			*(node_info++) = quadtree_fill_node(	\
-				node->heads[0],						\
+				node->children + 0,					\
 				((half_extent_t)					\
 				{									\
 					.x = info.extent.x - half_w,	\
@@ -132,7 +339,7 @@ do													\
 		if(_extent.max_y >= info.extent.y)			\
 		{											\
 			*(node_info++) = quadtree_fill_node(	\
-				node->heads[1],						\
+				node->children + 1,					\
 				((half_extent_t)					\
 				{									\
 					.x = info.extent.x - half_w,	\
@@ -149,7 +356,7 @@ do													\
 		if(_extent.min_y <= info.extent.y)			\
 		{											\
 			*(node_info++) = quadtree_fill_node(	\
-				node->heads[2],						\
+				node->children + 2,					\
 				((half_extent_t)					\
 				{									\
 					.x = info.extent.x + half_w,	\
@@ -163,7 +370,7 @@ do													\
 		if(_extent.max_y >= info.extent.y)			\
 		{											\
 			*(node_info++) = quadtree_fill_node(	\
-				node->heads[3],						\
+				node->children + 3,					\
 				((half_extent_t)					\
 				{									\
 					.x = info.extent.x + half_w,	\
@@ -185,7 +392,7 @@ do											\
 	float half_h = info.extent.h * 0.5f;	\
 											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[0],						\
+		node->children + 0,					\
 		((half_extent_t)					\
 		{									\
 			.x = info.extent.x - half_w,	\
@@ -197,7 +404,7 @@ do											\
 		);									\
 											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[1],						\
+		node->children + 1,					\
 		((half_extent_t)					\
 		{									\
 			.x = info.extent.x - half_w,	\
@@ -209,7 +416,7 @@ do											\
 		);									\
 											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[2],						\
+		node->children + 2,					\
 		((half_extent_t)					\
 		{									\
 			.x = info.extent.x + half_w,	\
@@ -221,7 +428,7 @@ do											\
 		);									\
 											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[3],						\
+		node->children + 3,					\
 		((half_extent_t)					\
 		{									\
 			.x = info.extent.x + half_w,	\
@@ -238,31 +445,46 @@ while(0)
 do											\
 {											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[0],						\
+		node->children + 0,					\
 		((half_extent_t){0}) __VA_OPT__(,)	\
 		__VA_ARGS__							\
 		);									\
 											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[1],						\
+		node->children + 1,					\
 		((half_extent_t){0}) __VA_OPT__(,)	\
 		__VA_ARGS__							\
 		);									\
 											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[2],						\
+		node->children + 2,					\
 		((half_extent_t){0}) __VA_OPT__(,)	\
 		__VA_ARGS__							\
 		);									\
 											\
 	*(node_info++) = quadtree_fill_node(	\
-		node->heads[3],						\
+		node->children + 3,					\
 		((half_extent_t){0}) __VA_OPT__(,)	\
-	  __VA_ARGS__							\
-	  );									\
+		__VA_ARGS__							\
+		);									\
 }											\
 while(0)
 
+#if QUADTREE_BRANCH_ENTITIES == 1
+	#define quadtree_descend_spill()						\
+	do													\
+	{													\
+		if(nodes[node->children + 4].head)				\
+		{												\
+			*node_info = info;							\
+			(node_info++)->node_idx = node->children + 4;	\
+		}												\
+	}													\
+	while(0)
+#else
+	#define quadtree_descend_spill() do {} while(0)
+#endif
+
 #define quadtree_reset_flags()								\
 do															\
 {															\
@@ -279,8 +501,330 @@ do															\
 }															\
 while(0);
 
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	#if QUADTREE_NODE_ENTITY_LINKS == 1
+		/* Linked again wherever normalize_dirty ends up placing them */
+		#define quadtree_unlink_dirty()					\
+		quadtree_unlink_node_entities(entities,			\
+			node_entities, node->head, node->count)
+	#else
+		#define quadtree_unlink_dirty() do {} while(0)
+	#endif
+
+	#define quadtree_mark_dirty(_node_idx)					\
+	do														\
+	{														\
+		if(!(node->position_flags & QUADTREE_NODE_DIRTY))	\
+		{													\
+			node->position_flags |= QUADTREE_NODE_DIRTY;	\
+			quadtree_dirty_push(qt, _node_idx,				\
+				node->head, node->count);					\
+			quadtree_unlink_dirty();						\
+		}													\
+	}														\
+	while(0)
+#else
+	#define quadtree_mark_dirty(_node_idx) do {} while(0)
+#endif
+
+
+#if QUADTREE_LOOSE == 1
+
+
+half_extent_t
+quadtree_loose_leaf_extent(
+	const quadtree_t* qt,
+	rect_extent_t extent
+	)
+{
+	const quadtree_node_t* nodes = qt->nodes;
+	half_extent_t leaf_extent = qt->half_extent;
+	uint32_t node_idx = 0;
+
+	float x = (extent.min_x + extent.max_x) * 0.5f;
+	float y = (extent.min_y + extent.max_y) * 0.5f;
+
+	while(nodes[node_idx].type != QUADTREE_NODE_TYPE_LEAF)
+	{
+		leaf_extent.w *= 0.5f;
+		leaf_extent.h *= 0.5f;
+
+		uint32_t child = 0;
+
+		if(x <= leaf_extent.x)
+		{
+			leaf_extent.x -= leaf_extent.w;
+		}
+		else
+		{
+			leaf_extent.x += leaf_extent.w;
+			child |= 2;
+		}
+
+		if(y <= leaf_extent.y)
+		{
+			leaf_extent.y -= leaf_extent.h;
+		}
+		else
+		{
+			leaf_extent.y += leaf_extent.h;
+			child |= 1;
+		}
+
+		node_idx = nodes[node_idx].children + child;
+	}
+
+	return leaf_extent;
+}
+
+
+/*
+ * The margin follows the entity's size, kept between the smallest leaf's and the size of the
+ * leaf the entity sits in, so points still get some slack and large entities don't reach many more leaves
+ */
+rect_extent_t
+quadtree_loose_extent(
+	const quadtree_t* qt,
+	rect_extent_t extent,
+	half_extent_t leaf_extent
+	)
+{
+	float min_half_size = qt->min_size * 0.5f;
+	float half_w = MACRO_MAX((extent.max_x - extent.min_x) * 0.5f, min_half_size);
+	float half_h = MACRO_MAX((extent.max_y - extent.min_y) * 0.5f, min_half_size);
+
+	float margin_x = MACRO_MIN(half_w, leaf_extent.w) * qt->looseness;
+	float margin_y = MACRO_MIN(half_h, leaf_extent.h) * qt->looseness;
+
+	return
+	(rect_extent_t)
+	{
+		.min_x = extent.min_x - margin_x,
+		.min_y = extent.min_y - margin_y,
+		.max_x = extent.max_x + margin_x,
+		.max_y = extent.max_y + margin_y
+	};
+}
+
+
+bool
+quadtree_loose_escaped(
+	const quadtree_entity_t* entity,
+	rect_extent_t extent
+	)
+{
+	return
+		extent.min_x < entity->loose_extent.min_x ||
+		extent.min_y < entity->loose_extent.min_y ||
+		extent.max_x > entity->loose_extent.max_x ||
+		extent.max_y > entity->loose_extent.max_y;
+}
+
+
+bool
+quadtree_loose_reaches(
+	rect_extent_t extent,
+	half_extent_t parent,
+	half_extent_t child
+	)
+{
+	return
+		(child.x < parent.x ? extent.min_x <= parent.x : extent.max_x >= parent.x) &&
+		(child.y < parent.y ? extent.min_y <= parent.y : extent.max_y >= parent.y);
+}
+
+
+void
+quadtree_loose_widen(
+	quadtree_t* qt,
+	quadtree_entity_t* entity,
+	uint32_t entity_idx
+	)
+{
+	rect_extent_t extent = quadtree_entity_extent(qt, entity, entity_idx);
+
+	entity->loose_extent.min_x = MACRO_MIN(entity->loose_extent.min_x, extent.min_x);
+	entity->loose_extent.min_y = MACRO_MIN(entity->loose_extent.min_y, extent.min_y);
+	entity->loose_extent.max_x = MACRO_MAX(entity->loose_extent.max_x, extent.max_x);
+	entity->loose_extent.max_y = MACRO_MAX(entity->loose_extent.max_y, extent.max_y);
+}
+
+
+#endif
+
+
+#if QUADTREE_NODE_ENTITY_EXTENT == 2
+
+
+uint16_t
+quadtree_quantize(
+	float value
+	)
+{
+	return MACRO_MIN(MACRO_MAX(value, 0.0f), 65535.0f);
+}
+
+
+quadtree_quantized_extent_t
+quadtree_quantize_extent(
+	rect_extent_t extent,
+	rect_extent_t node_extent
+	)
+{
+	float scale_x = 65535.0f / (node_extent.max_x - node_extent.min_x);
+	float scale_y = 65535.0f / (node_extent.max_y - node_extent.min_y);
+
+	/* A step of slack each way covers the rounding of the scaling itself */
+	return
+	(quadtree_quantized_extent_t)
+	{
+		.min_x = quadtree_quantize((extent.min_x - node_extent.min_x) * scale_x - 1.0f),
+		.min_y = quadtree_quantize((extent.min_y - node_extent.min_y) * scale_y - 1.0f),
+		.max_x = quadtree_quantize((extent.max_x - node_extent.min_x) * scale_x + 2.0f),
+		.max_y = quadtree_quantize((extent.max_y - node_extent.min_y) * scale_y + 2.0f)
+	};
+}
+
+
+bool
+quadtree_quantized_intersects(
+	quadtree_quantized_extent_t a,
+	quadtree_quantized_extent_t b
+	)
+{
+	return
+		a.min_x <= b.max_x &&
+		a.min_y <= b.max_y &&
+		b.min_x <= a.max_x &&
+		b.min_y <= a.max_y;
+}
+
+
+rect_extent_t
+quadtree_child_rect_extent(
+	half_extent_t extent,
+	uint32_t child
+	)
+{
+#if QUADTREE_BRANCH_ENTITIES == 1
+	if(child == 4)
+	{
+		return half_to_rect_extent(extent);
+	}
+#endif
+
+	float half_w = extent.w * 0.5f;
+	float half_h = extent.h * 0.5f;
+
+	return half_to_rect_extent(
+		(half_extent_t)
+		{
+			.x = extent.x + ((child & 2) ? half_w : -half_w),
+			.y = extent.y + ((child & 1) ? half_h : -half_h),
+			.w = half_w,
+			.h = half_h
+		}
+		);
+}
+
+
+#endif
+
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+
+
+bool
+quadtree_branch_holds(
+	const quadtree_t* qt,
+	rect_extent_t extent,
+	half_extent_t node_extent
+	)
+{
+	return
+		extent.max_x - extent.min_x >= node_extent.w * qt->branch_entity_size ||
+		extent.max_y - extent.min_y >= node_extent.h * qt->branch_entity_size;
+}
+
+
+#endif
+
+
+uint32_t
+quadtree_handle_alloc(
+	quadtree_t* qt
+	)
+{
+	if(qt->free_handle)
+	{
+		uint32_t handle_idx = qt->free_handle;
+		qt->free_handle = qt->handles[handle_idx].next;
+
+		return handle_idx;
+	}
+
+	if(qt->handles_used >= qt->handles_size)
+	{
+		uint32_t new_size = (qt->handles_used << 1) | 3;
+		assert_neq(new_size, qt->handles_size);
+
+		qt->handles = quadtree_heap_call(alloc_remalloc(qt->handles, qt->handles_size, new_size));
+		assert_not_null(qt->handles);
+
+#if QUADTREE_ENTITY_SOA == 1
+		qt->entity_data = quadtree_heap_call(alloc_remalloc(qt->entity_data, qt->handles_size, new_size));
+		assert_not_null(qt->entity_data);
+#endif
+
+		qt->handles_size = new_size;
+	}
+
+	uint32_t handle_idx = qt->handles_used++;
+	assert_le(handle_idx, QUADTREE_HANDLE_INDEX_MASK);
+
+	qt->handles[handle_idx].generation = 0;
+
+	return handle_idx;
+}
+
 
 void
+quadtree_handle_free(
+	quadtree_t* qt,
+	uint32_t handle_idx
+	)
+{
+	quadtree_handle_slot_t* handle = qt->handles + handle_idx;
+
+	/* Past this its handles would wrap around to ones given out before, so the slot is never reused */
+	if(handle->generation > QUADTREE_HANDLE_GENERATION_MASK)
+	{
+		return;
+	}
+
+	handle->next = qt->free_handle;
+
+	qt->free_handle = handle_idx;
+}
+
+
+bool
+quadtree_handle_valid(
+	const quadtree_t* qt,
+	quadtree_handle_t handle
+	)
+{
+	uint32_t handle_idx = handle & QUADTREE_HANDLE_INDEX_MASK;
+	if(!handle_idx || handle_idx >= qt->handles_used)
+	{
+		return false;
+	}
+
+	return qt->handles[handle_idx].generation == handle >> QUADTREE_HANDLE_INDEX_BITS;
+}
+
+
+quadtree_handle_t
 quadtree_insert(
 	quadtree_t* qt,
 	const quadtree_entity_data* data
@@ -289,12 +833,17 @@ quadtree_insert(
 	assert_not_null(qt);
 	assert_not_null(data);
 
+	uint32_t handle_idx = quadtree_handle_alloc(qt);
+	quadtree_handle_slot_t* handle = qt->handles + handle_idx;
+
+	handle->entity_idx = 0;
+
 	if(qt->insertions_used >= qt->insertions_size)
 	{
 		uint32_t new_size = (qt->insertions_used << 1) | 3;
 		assert_neq(new_size, qt->insertions_size);
 
-		qt->insertions = alloc_remalloc(qt->insertions, qt->insertions_size, new_size);
+		qt->insertions = quadtree_heap_call(alloc_remalloc(qt->insertions, qt->insertions_size, new_size));
 		assert_not_null(qt->insertions);
 
 		qt->insertions_size = new_size;
@@ -303,9 +852,16 @@ quadtree_insert(
 	uint32_t insertion_idx = qt->insertions_used++;
 	quadtree_insertion_t* insertion = qt->insertions + insertion_idx;
 
+#if QUADTREE_ENTITY_SOA == 1
+	qt->entity_data[handle_idx] = *data;
+#else
 	insertion->data = *data;
+#endif
+	insertion->handle_idx = handle_idx;
 
 	qt->normalization |= QUADTREE_NOT_NORMALIZED_HARD;
+
+	return (handle->generation << QUADTREE_HANDLE_INDEX_BITS) | handle_idx;
 }
 
 
@@ -319,12 +875,15 @@ quadtree_remove(
 	assert_gt(entity_idx, 0);
 	assert_lt(entity_idx, qt->entities_used);
 
+	/* Handles to the entity stop resolving now rather than after the next normalize */
+	++qt->handles[qt->entities[entity_idx].handle_idx].generation;
+
 	if(qt->removals_used >= qt->removals_size)
 	{
 		uint32_t new_size = (qt->removals_used << 1) | 3;
 		assert_neq(new_size, qt->removals_size);
 
-		qt->removals = alloc_remalloc(qt->removals, qt->removals_size, new_size);
+		qt->removals = quadtree_heap_call(alloc_remalloc(qt->removals, qt->removals_size, new_size));
 		assert_not_null(qt->removals);
 
 		qt->removals_size = new_size;
@@ -340,1413 +899,6385 @@ quadtree_remove(
 
 
 void
-quadtree_normalize(
-	quadtree_t* qt
+quadtree_remove_handle(
+	quadtree_t* qt,
+	quadtree_handle_t handle
 	)
 {
 	assert_not_null(qt);
 
-	if(qt->normalization == QUADTREE_NORMALIZED)
+	if(!quadtree_handle_valid(qt, handle))
 	{
 		return;
 	}
 
-	qt->normalization = QUADTREE_NORMALIZED;
+	uint32_t handle_idx = handle & QUADTREE_HANDLE_INDEX_MASK;
+	quadtree_handle_slot_t* slot = qt->handles + handle_idx;
 
-	quadtree_node_t* nodes = qt->nodes;
-	quadtree_node_entities_t node_entities = qt->node_entities;
-	quadtree_entity_t* entities = qt->entities;
+	if(slot->entity_idx)
+	{
+		quadtree_remove(qt, slot->entity_idx);
+		return;
+	}
 
-	uint32_t free_node_entity = 0;
-	uint32_t node_entities_used = qt->node_entities_used;
-	uint32_t node_entities_size = qt->node_entities_size;
+	/* Inserted since the last normalize, so there is only the insertion to drop */
+	uint32_t insertion_idx = 0;
 
-	uint32_t free_entity = 0;
-	uint32_t entities_used = qt->entities_used;
-	uint32_t entities_size = qt->entities_size;
+	while(qt->insertions[insertion_idx].handle_idx != handle_idx)
+	{
+		++insertion_idx;
+		assert_lt(insertion_idx, qt->insertions_used);
+	}
 
-	quadtree_node_info_t node_infos[qt->dfs_length];
-	quadtree_node_info_t* node_info;
+	--qt->insertions_used;
+	memmove(qt->insertions + insertion_idx, qt->insertions + insertion_idx + 1,
+		sizeof(*qt->insertions) * (qt->insertions_used - insertion_idx));
 
+	++slot->generation;
+	quadtree_handle_free(qt, handle_idx);
+}
 
-	if(qt->node_removals_used)
-	{
-		quadtree_node_removal_t* node_removals = qt->node_removals;
-		quadtree_node_removal_t* node_removal = node_removals + qt->node_removals_used - 1;
 
-		while(node_removal >= node_removals)
-		{
-			uint32_t node_idx = node_removal->node_idx;
-			quadtree_node_t* node = nodes + node_idx;
+uint32_t
+quadtree_resolve(
+	const quadtree_t* qt,
+	quadtree_handle_t handle
+	)
+{
+	assert_not_null(qt);
 
-			uint32_t node_entity_idx = node_removal->node_entity_idx;
-			uint32_t* node_entity_next = node_entities.next + node_entity_idx;
-			uint32_t entity_idx = node_removal->entity_idx;
+	if(!quadtree_handle_valid(qt, handle))
+	{
+		return 0;
+	}
 
-			uint32_t next = *node_entity_next;
-			quadtree_entity_t* entity = entities + entity_idx;
+	return qt->handles[handle & QUADTREE_HANDLE_INDEX_MASK].entity_idx;
+}
 
-			if(node->head != node_entity_idx)
-			{
-				*(node_entity_next - 1) = next;
-				if(!next)
-				{
-					node_entities.entities[node_entity_idx - 1].is_last = true;
-				}
-			}
-			else
-			{
-				node->head = next;
-			}
 
-			--node->count;
-			--entity->in_nodes_minus_one;
+quadtree_handle_t
+quadtree_get_handle(
+	const quadtree_t* qt,
+	uint32_t entity_idx
+	)
+{
+	assert_not_null(qt);
+	assert_gt(entity_idx, 0);
+	assert_lt(entity_idx, qt->entities_used);
 
-			*node_entity_next = free_node_entity;
-			free_node_entity = node_entity_idx;
+	uint32_t handle_idx = qt->entities[entity_idx].handle_idx;
 
-			--node_removal;
-		}
+	return (qt->handles[handle_idx].generation << QUADTREE_HANDLE_INDEX_BITS) | handle_idx;
+}
 
-		alloc_free(node_removals, qt->node_removals_size);
-		qt->node_removals = NULL;
-		qt->node_removals_used = 0;
-		qt->node_removals_size = 0;
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+
+
+void
+quadtree_link_node_entities(
+	quadtree_entity_t* entities,
+	quadtree_node_entities_t node_entities,
+	uint32_t node_idx,
+	uint32_t head,
+	uint32_t count
+	)
+{
+	uint32_t node_entity_end = head + count;
+
+	for(uint32_t node_entity_idx = head; node_entity_idx != node_entity_end; ++node_entity_idx)
+	{
+		quadtree_entity_t* entity = entities + node_entities.entities[node_entity_idx].index;
+
+		node_entities.links[node_entity_idx].node_idx = node_idx;
+		node_entities.links[node_entity_idx].next = entity->node_entity;
+		entity->node_entity = node_entity_idx;
 	}
+}
 
 
+void
+quadtree_unlink_node_entities(
+	quadtree_entity_t* entities,
+	quadtree_node_entities_t node_entities,
+	uint32_t head,
+	uint32_t count
+	)
+{
+	uint32_t node_entity_end = head + count;
+
+	for(uint32_t node_entity_idx = head; node_entity_idx != node_entity_end; ++node_entity_idx)
 	{
-		quadtree_reinsertion_t* reinsertions = qt->reinsertions;
-		quadtree_reinsertion_t* reinsertion = reinsertions;
-		quadtree_reinsertion_t* reinsertion_end = reinsertion + qt->reinsertions_used;
+		uint32_t* link = &entities[node_entities.entities[node_entity_idx].index].node_entity;
 
-		while(reinsertion != reinsertion_end)
+		while(*link != node_entity_idx)
 		{
-			uint32_t entity_idx = reinsertion->entity_idx;
-			quadtree_entity_t* entity = entities + entity_idx;
+			link = &node_entities.links[*link].next;
+		}
 
-			rect_extent_t entity_extent = quadtree_get_entity_rect_extent(entity);
-			uint32_t in_nodes = 0;
+		*link = node_entities.links[node_entity_idx].next;
+	}
+}
 
-			node_info = node_infos;
 
-			*(node_info++) =
-			(quadtree_node_info_t)
-			{
-				.node_idx = 0,
-				.extent = qt->half_extent
-			};
+#endif
 
-			do
-			{
-				quadtree_node_info_t info = *(--node_info);
-				quadtree_node_t* node = nodes + info.node_idx;
 
-				if(node->type != QUADTREE_NODE_TYPE_LEAF)
-				{
-					quadtree_descend(entity_extent);
-					continue;
-				}
+rect_extent_t
+quadtree_query_child_bounds(
+	rect_extent_t bounds,
+	half_extent_t parent,
+	half_extent_t child
+	)
+{
+	return
+	(rect_extent_t)
+	{
+		.min_x = child.x < parent.x ? bounds.min_x : parent.x,
+		.min_y = child.y < parent.y ? bounds.min_y : parent.y,
+		.max_x = child.x < parent.x ? parent.x : bounds.max_x,
+		.max_y = child.y < parent.y ? parent.y : bounds.max_y
+	};
+}
 
-				rect_extent_t node_extent = half_to_rect_extent(info.extent);
-				uint32_t node_entity_idx = node->head;
 
-				++in_nodes;
+typedef struct quadtree_count_node_info
+{
+	uint32_t node_idx;
+	half_extent_t extent;
+	rect_extent_t bounds;
+	bool summed;
+}
+quadtree_count_node_info_t;
 
-				while(node_entity_idx)
-				{
-					if(node_entities.entities[node_entity_idx].index == entity_idx)
-					{
-						goto goto_skip;
-					}
 
-					node_entity_idx = node_entities.next[node_entity_idx];
-				}
+#undef quadtree_fill_node
+#define quadtree_fill_node(_node_idx, _extent)							\
+(quadtree_count_node_info_t)											\
+{																		\
+	.node_idx = _node_idx,												\
+	.extent = _extent,													\
+	.bounds = quadtree_query_child_bounds(info.bounds, info.extent, _extent)	\
+}
 
-				if(free_node_entity)
-				{
-					node_entity_idx = free_node_entity;
-					free_node_entity = node_entities.next[node_entity_idx];
-				}
-				else
-				{
-					if(node_entities_used >= node_entities_size)
-					{
-						uint32_t new_size = (node_entities_used << 1) | 3;
-						assert_neq(new_size, node_entities_size);
 
-						node_entities.next = alloc_remalloc(node_entities.next, node_entities_size, new_size);
-						assert_not_null(node_entities.next);
+bool
+quadtree_count_owns(
+	rect_extent_t bounds,
+	float x,
+	float y
+	)
+{
+	return
+		x >= bounds.min_x &&
+		y >= bounds.min_y &&
+		x < bounds.max_x &&
+		y < bounds.max_y;
+}
 
-						node_entities.entities = alloc_remalloc(node_entities.entities, node_entities_size, new_size);
-						assert_not_null(node_entities.entities);
 
-						node_entities.flags = alloc_remalloc(node_entities.flags, node_entities_size, new_size);
-						assert_not_null(node_entities.flags);
+void
+quadtree_node_sums_reserve(
+	quadtree_t* qt,
+	uint32_t nodes_size
+	)
+{
+	if(qt->node_counts_size < nodes_size)
+	{
+		qt->node_counts = quadtree_heap_call(alloc_remalloc(qt->node_counts, qt->node_counts_size, nodes_size));
+		assert_not_null(qt->node_counts);
 
-						node_entities_size = new_size;
-					}
+		qt->node_counts_size = nodes_size;
+	}
 
-					node_entity_idx = node_entities_used++;
-				}
+#ifdef quadtree_node_aggregate
+	if(qt->node_aggregates_size < nodes_size)
+	{
+		qt->node_aggregates = quadtree_heap_call(alloc_remalloc(qt->node_aggregates, qt->node_aggregates_size, nodes_size));
+		assert_not_null(qt->node_aggregates);
 
-				node_entities.next[node_entity_idx] = node->head;
-				node_entities.entities[node_entity_idx].is_last = !node->head;
-				node_entities.entities[node_entity_idx].index = entity_idx;
-				node->head = node_entity_idx;
+		qt->node_aggregates_size = nodes_size;
+	}
+#endif
+}
 
-				++node->count;
 
-				goto_skip:;
+void
+quadtree_node_sums_reset(
+	quadtree_t* qt,
+	uint32_t node_idx
+	)
+{
+	qt->node_counts[node_idx] = (quadtree_node_count_t){0};
+#ifdef quadtree_node_aggregate
+	quadtree_aggregate_reset(qt->node_aggregates + node_idx);
+#endif
+}
 
-				quadtree_reset_flags();
-			}
-			while(node_info != node_infos);
 
-			assert_neq(in_nodes, 0);
-			entity->in_nodes_minus_one = in_nodes - 1;
+void
+quadtree_node_sums_add(
+	quadtree_t* qt,
+	uint32_t node_idx,
+	rect_extent_t bounds,
+	quadtree_entity_t* entity,
+	uint32_t entity_idx
+	)
+{
+	quadtree_node_count_t* node_count = qt->node_counts + node_idx;
+	rect_extent_t entity_extent = quadtree_entity_extent(qt, entity, entity_idx);
+
+#ifdef quadtree_node_aggregate
+	/* Added once, in the leaf holding the entity's center */
+	if(quadtree_count_owns(bounds,
+		(entity_extent.min_x + entity_extent.max_x) * 0.5f,
+		(entity_extent.min_y + entity_extent.max_y) * 0.5f))
+	{
+		quadtree_aggregate_add(qt->node_aggregates + node_idx, quadtree_entity_payload(qt, entity));
+	}
+#endif
 
-			++reinsertion;
-		}
+	node_count->corners[0] += quadtree_count_owns(bounds, entity_extent.min_x, entity_extent.min_y);
+	node_count->corners[1] += quadtree_count_owns(bounds, entity_extent.min_x, entity_extent.max_y);
+	node_count->corners[2] += quadtree_count_owns(bounds, entity_extent.max_x, entity_extent.min_y);
+	node_count->corners[3] += quadtree_count_owns(bounds, entity_extent.max_x, entity_extent.max_y);
+}
 
-		alloc_free(reinsertions, qt->reinsertions_size);
-		qt->reinsertions = NULL;
-		qt->reinsertions_used = 0;
-		qt->reinsertions_size = 0;
-	}
 
+void
+quadtree_node_sums_combine(
+	quadtree_t* qt,
+	uint32_t node_idx
+	)
+{
+	uint32_t children_idx = qt->nodes[node_idx].children;
+	quadtree_node_count_t* node_counts = qt->node_counts;
+	quadtree_node_count_t* node_count = node_counts + node_idx;
 
+	for(uint32_t i = 0; i < 4; ++i)
 	{
-		quadtree_removal_t* removals = qt->removals;
-		quadtree_removal_t* removal = removals;
-		quadtree_removal_t* removal_end = removal + qt->removals_used;
+		node_count->corners[i] = 0;
 
-		while(removal != removal_end)
+		for(uint32_t j = 0; j < QUADTREE_NODE_BLOCK; ++j)
 		{
-			node_info = node_infos;
+			node_count->corners[i] += node_counts[children_idx + j].corners[i];
+		}
+	}
 
-			*(node_info++) =
-			(quadtree_node_info_t)
-			{
-				.node_idx = 0,
-				.extent = qt->half_extent
-			};
+#ifdef quadtree_node_aggregate
+	quadtree_node_aggregate* node_aggregate = qt->node_aggregates + node_idx;
+	quadtree_aggregate_reset(node_aggregate);
 
-			uint32_t entity_idx = removal->entity_idx;
-			quadtree_entity_t* entity = entities + entity_idx;
-			rect_extent_t entity_extent = quadtree_get_entity_rect_extent(entity);
+	for(uint32_t i = 0; i < QUADTREE_NODE_BLOCK; ++i)
+	{
+		quadtree_aggregate_combine(node_aggregate, qt->node_aggregates + children_idx + i);
+	}
+#endif
+}
 
-			do
-			{
-				quadtree_node_info_t info = *(--node_info);
-				quadtree_node_t* node = nodes + info.node_idx;
 
-				if(node->type != QUADTREE_NODE_TYPE_LEAF)
-				{
-					quadtree_descend(entity_extent);
-					continue;
-				}
+/* Children are laid out after their parents, so walking back sums them first */
+void
+quadtree_node_sums_combine_all(
+	quadtree_t* qt
+	)
+{
+	uint32_t node_idx = qt->nodes_used;
 
-				uint32_t prev_node_entity_idx = 0;
-				uint32_t node_entity_idx = node->head;
+	while(node_idx--)
+	{
+		if(qt->nodes[node_idx].type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_node_sums_combine(qt, node_idx);
+		}
+	}
+}
 
-				while(node_entity_idx)
-				{
-					if(node_entities.entities[node_entity_idx].index == entity_idx)
-					{
-						if(prev_node_entity_idx)
-						{
-							node_entities.next[prev_node_entity_idx] = node_entities.next[node_entity_idx];
-							if(!node_entities.next[prev_node_entity_idx])
-							{
-								node_entities.entities[prev_node_entity_idx].is_last = true;
-							}
-						}
-						else
-						{
-							node->head = node_entities.next[node_entity_idx];
-						}
 
-						--node->count;
+void
+quadtree_node_sums_subtree(
+	quadtree_t* qt,
+	quadtree_count_node_info_t root_info
+	)
+{
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+	quadtree_entity_t* entities = qt->entities;
 
-						node_entities.next[node_entity_idx] = free_node_entity;
-						free_node_entity = node_entity_idx;
+	/* Internal nodes are pushed a second time to sum their children once those are done */
+	quadtree_count_node_info_t node_infos[qt->dfs_length + qt->max_depth];
+	quadtree_count_node_info_t* node_info = node_infos;
 
-						break;
-					}
+	*(node_info++) = root_info;
 
-					prev_node_entity_idx = node_entity_idx;
-					node_entity_idx = node_entities.next[node_entity_idx];
-				}
+	do
+	{
+		quadtree_count_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			if(info.summed)
+			{
+				quadtree_node_sums_combine(qt, info.node_idx);
+				continue;
 			}
-			while(node_info != node_infos);
 
-			entity->next = free_entity;
-			free_entity = entity_idx;
+			info.summed = true;
+			*(node_info++) = info;
 
-			++removal;
+			quadtree_descend_all();
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+			/* Even when empty, its sums are added to the branch's */
+			info.summed = false;
+			*node_info = info;
+			(node_info++)->node_idx = node->children + 4;
+#endif
+			continue;
 		}
 
-		alloc_free(removals, qt->removals_size);
-		qt->removals = NULL;
-		qt->removals_used = 0;
-		qt->removals_size = 0;
-	}
-
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		/* Summed once normalize_dirty has gathered it */
+		if(node->position_flags & QUADTREE_NODE_DIRTY)
+		{
+			continue;
+		}
+#endif
 
-	{
-		quadtree_insertion_t* insertions = qt->insertions;
-		quadtree_insertion_t* insertion = insertions;
-		quadtree_insertion_t* insertion_end = insertion + qt->insertions_used;
+		quadtree_node_sums_reset(qt, info.node_idx);
 
-		while(insertion != insertion_end)
+		uint32_t idx = node->head;
+		if(!idx)
 		{
-			quadtree_entity_data* data = &insertion->data;
+			continue;
+		}
 
-			uint32_t entity_idx;
-			quadtree_entity_t* entity;
+		quadtree_node_entity_t* node_entity = node_entities + idx;
 
-			if(free_entity)
+		while(1)
+		{
+			uint32_t entity_idx = node_entity->index;
+			quadtree_node_sums_add(qt, info.node_idx, info.bounds, entities + entity_idx, entity_idx);
+
+			if(node_entity->is_last)
 			{
-				entity_idx = free_entity;
-				entity = entities + entity_idx;
-				free_entity = entity->next;
+				break;
 			}
-			else
-			{
-				if(entities_used >= entities_size)
-				{
-					uint32_t new_size = (entities_used << 1) | 3;
-					assert_neq(new_size, entities_size);
-
-					entities = alloc_remalloc(entities, entities_size, new_size);
-					assert_not_null(entities);
+			++node_entity;
+		}
+	}
+	while(node_info != node_infos);
+}
 
-					entities_size = new_size;
-				}
 
-				entity_idx = entities_used++;
-				entity = entities + entity_idx;
-			}
+/* Sums the subtree at node_idx again, then every branch above it */
+void
+quadtree_node_sums_fix(
+	quadtree_t* qt,
+	uint32_t node_idx,
+	float x,
+	float y
+	)
+{
+	quadtree_node_t* nodes = qt->nodes;
 
-			entity->data = *data;
-			entity->query_tick = qt->query_tick;
-			entity->update_tick = qt->update_tick;
-			entity->reinsertion_tick = qt->update_tick;
+	uint32_t path[qt->max_depth];
+	uint32_t path_length = 0;
 
-			rect_extent_t entity_extent = quadtree_get_entity_rect_extent(entity);
-			uint32_t in_nodes = 0;
+	quadtree_count_node_info_t info =
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
+	};
 
-			node_info = node_infos;
+	while(info.node_idx != node_idx)
+	{
+		quadtree_node_t* node = nodes + info.node_idx;
+		assert_neq(node->type, QUADTREE_NODE_TYPE_LEAF);
 
-			*(node_info++) =
-			(quadtree_node_info_t)
-			{
-				.node_idx = 0,
-				.extent = qt->half_extent
-			};
+		path[path_length++] = info.node_idx;
 
-			do
-			{
-				quadtree_node_info_t info = *(--node_info);
-				quadtree_node_t* node = nodes + info.node_idx;
+#if QUADTREE_BRANCH_ENTITIES == 1
+		if(node->children + 4 == node_idx)
+		{
+			info.node_idx = node_idx;
+			break;
+		}
+#endif
 
-				if(node->type != QUADTREE_NODE_TYPE_LEAF)
-				{
-					quadtree_descend(entity_extent);
-					continue;
-				}
+		half_extent_t extent = info.extent;
+		extent.w *= 0.5f;
+		extent.h *= 0.5f;
 
-				rect_extent_t node_extent = half_to_rect_extent(info.extent);
-				uint32_t node_entity_idx;
+		uint32_t child = 0;
 
-				++in_nodes;
+		if(x <= extent.x)
+		{
+			extent.x -= extent.w;
+		}
+		else
+		{
+			extent.x += extent.w;
+			child |= 2;
+		}
 
-				if(free_node_entity)
-				{
-					node_entity_idx = free_node_entity;
-					free_node_entity = node_entities.next[node_entity_idx];
-				}
-				else
-				{
-					if(node_entities_used >= node_entities_size)
-					{
-						uint32_t new_size = (node_entities_used << 1) | 3;
-						assert_neq(new_size, node_entities_size);
+		if(y <= extent.y)
+		{
+			extent.y -= extent.h;
+		}
+		else
+		{
+			extent.y += extent.h;
+			child |= 1;
+		}
 
-						node_entities.next = alloc_remalloc(node_entities.next, node_entities_size, new_size);
-						assert_not_null(node_entities.next);
+		info.bounds = quadtree_query_child_bounds(info.bounds, info.extent, extent);
+		info.extent = extent;
+		info.node_idx = node->children + child;
+	}
 
-						node_entities.entities = alloc_remalloc(node_entities.entities, node_entities_size, new_size);
-						assert_not_null(node_entities.entities);
+	quadtree_node_sums_subtree(qt, info);
 
-						node_entities.flags = alloc_remalloc(node_entities.flags, node_entities_size, new_size);
-						assert_not_null(node_entities.flags);
+	while(path_length)
+	{
+		quadtree_node_sums_combine(qt, path[--path_length]);
+	}
+}
 
-						node_entities_size = new_size;
-					}
 
-					node_entity_idx = node_entities_used++;
-				}
+void
+quadtree_node_sums_fix_stale(
+	quadtree_t* qt
+	)
+{
+	quadtree_stale_node_t* stale_node = qt->stale_nodes;
+	quadtree_stale_node_t* stale_node_end = stale_node + qt->stale_nodes_used;
 
-				node_entities.next[node_entity_idx] = node->head;
-				node_entities.entities[node_entity_idx].is_last = !node->head;
-				node_entities.entities[node_entity_idx].index = entity_idx;
-				node->head = node_entity_idx;
+	for(; stale_node != stale_node_end; ++stale_node)
+	{
+		quadtree_node_sums_fix(qt, stale_node->node_idx, stale_node->x, stale_node->y);
+	}
 
-				quadtree_reset_flags();
+	qt->stale_nodes_used = 0;
+}
 
-				++node->count;
-			}
-			while(node_info != node_infos);
 
-			assert_neq(in_nodes, 0);
-			entity->in_nodes_minus_one = in_nodes - 1;
+void
+quadtree_stale_push(
+	quadtree_t* qt,
+	uint32_t node_idx,
+	float x,
+	float y
+	)
+{
+	if(!qt->node_sums_valid)
+	{
+		return;
+	}
 
-			++insertion;
-		}
+	/* Consecutive entities of a leaf all report it */
+	if(qt->stale_nodes_used && qt->stale_nodes[qt->stale_nodes_used - 1].node_idx == node_idx)
+	{
+		return;
+	}
 
-		alloc_free(insertions, qt->insertions_size);
-		qt->insertions = NULL;
-		qt->insertions_used = 0;
-		qt->insertions_size = 0;
+	/* Past this many, summing the whole tree again is cheaper than fixing them one by one */
+	if(qt->stale_nodes_used > qt->nodes_used >> 2)
+	{
+		qt->node_sums_valid = false;
+		qt->stale_nodes_used = 0;
+		return;
 	}
 
+	if(qt->stale_nodes_used >= qt->stale_nodes_size)
+	{
+		uint32_t new_size = (qt->stale_nodes_used << 1) | 3;
+		assert_neq(new_size, qt->stale_nodes_size);
+
+		qt->stale_nodes = quadtree_heap_call(alloc_remalloc(qt->stale_nodes, qt->stale_nodes_size, new_size));
+		assert_not_null(qt->stale_nodes);
 
+		qt->stale_nodes_size = new_size;
+	}
+
+	qt->stale_nodes[qt->stale_nodes_used++] =
+	(quadtree_stale_node_t)
 	{
-		uint32_t free_node = 0;
-		uint32_t nodes_used = qt->nodes_used;
-		uint32_t nodes_size = qt->nodes_size;
+		.node_idx = node_idx,
+		.x = x,
+		.y = y
+	};
+}
 
-		quadtree_node_t* new_nodes;
-		quadtree_node_entities_t new_node_entities;
-		quadtree_entity_t* new_entities;
 
-		uint32_t new_nodes_used = 0;
-		uint32_t new_nodes_size;
+void
+quadtree_node_sums_refresh(
+	quadtree_t* qt
+	)
+{
+	if(qt->node_sums_valid)
+	{
+		quadtree_node_sums_fix_stale(qt);
+		return;
+	}
 
-		if(nodes_size >> 2 < nodes_used)
-		{
-			new_nodes_size = nodes_size;
-		}
-		else
+	quadtree_node_sums_reserve(qt, qt->nodes_size);
+
+	quadtree_node_sums_subtree(qt,
+		(quadtree_count_node_info_t)
 		{
-			new_nodes_size = nodes_size >> 1;
+			.node_idx = 0,
+			.extent = qt->half_extent,
+			.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
 		}
+		);
 
-		uint32_t new_node_entities_used = 1;
-		uint32_t new_node_entities_size;
+	qt->stale_nodes_used = 0;
+	qt->node_sums_valid = true;
+}
 
-		if(node_entities_size >> 2 < node_entities_used)
-		{
-			new_node_entities_size = node_entities_size;
-		}
-		else
-		{
-			new_node_entities_size = node_entities_size >> 1;
-		}
 
-		uint32_t new_entities_used = 1;
-		uint32_t new_entities_size;
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
 
-		if(entities_size >> 2 < entities_used)
-		{
-			new_entities_size = entities_size;
-		}
-		else
-		{
-			new_entities_size = entities_size >> 1;
-		}
 
-		new_nodes = alloc_malloc(new_nodes, new_nodes_size);
-		assert_ptr(new_nodes, new_nodes_size);
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
 
-		new_node_entities.next = alloc_malloc(new_node_entities.next, new_node_entities_size);
-		assert_ptr(new_node_entities.next, new_node_entities_size);
 
-		new_node_entities.entities = alloc_malloc(new_node_entities.entities, new_node_entities_size);
-		assert_ptr(new_node_entities.entities, new_node_entities_size);
+void
+quadtree_dirty_push(
+	quadtree_t* qt,
+	uint32_t node_idx,
+	uint32_t head,
+	uint32_t count
+	)
+{
+	if(qt->dirty_nodes_used >= qt->dirty_nodes_size)
+	{
+		uint32_t new_size = (qt->dirty_nodes_used << 1) | 3;
+		assert_neq(new_size, qt->dirty_nodes_size);
 
-		new_node_entities.flags = alloc_malloc(new_node_entities.flags, new_node_entities_size);
-		assert_ptr(new_node_entities.flags, new_node_entities_size);
+		qt->dirty_nodes = quadtree_heap_call(alloc_remalloc(qt->dirty_nodes, qt->dirty_nodes_size, new_size));
+		assert_not_null(qt->dirty_nodes);
 
-		new_entities = alloc_malloc(new_entities, new_entities_size);
-		assert_ptr(new_entities, new_entities_size);
+		qt->dirty_nodes_size = new_size;
+	}
 
-		uint32_t* entity_map = alloc_calloc(entity_map, entities_size);
-		assert_ptr(entity_map, entities_size);
+	uint32_t dirty_node_idx = qt->dirty_nodes_used++;
+	quadtree_dirty_node_t* dirty_node = qt->dirty_nodes + dirty_node_idx;
 
+	dirty_node->node_idx = node_idx;
+	dirty_node->head = head;
+	dirty_node->count = count;
+}
 
-		typedef struct quadtree_node_reorder_info
-		{
-			uint32_t node_idx;
-			half_extent_t extent;
-			uint32_t parent_node_idx;
-			uint32_t head_idx;
-			uint32_t depth;
-		}
-		quadtree_node_reorder_info_t;
 
-		quadtree_node_reorder_info_t node_infos[qt->dfs_length];
-		quadtree_node_reorder_info_t* node_info = node_infos;
+half_extent_t
+quadtree_node_extent(
+	quadtree_t* qt,
+	uint32_t node_idx,
+	uint32_t* depth
+	)
+{
+	uint8_t path[qt->max_depth];
+	uint32_t path_length = 0;
 
-		*(node_info++) =
-		(quadtree_node_reorder_info_t)
-		{
-			.node_idx = 0,
-			.extent = qt->half_extent,
-			.parent_node_idx = 0,
-			.head_idx = 0,
-			.depth = 1
-		};
+	while(node_idx)
+	{
+		uint32_t parent_idx = qt->node_parents[node_idx];
+		quadtree_node_t* parent = qt->nodes + parent_idx;
 
-		do
+		uint32_t head_idx = node_idx - parent->children;
+		node_idx = parent_idx;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+		/* The node holding a branch's own entities shares its depth and extent */
+		if(head_idx == 4)
 		{
-			quadtree_node_reorder_info_t info = *(--node_info);
-			quadtree_node_t* node = nodes + info.node_idx;
+			continue;
+		}
+#endif
 
-			uint32_t new_node_idx = new_nodes_used++;
-			quadtree_node_t* new_node = new_nodes + new_node_idx;
+		path[path_length++] = head_idx;
+	}
 
-			new_nodes[info.parent_node_idx].heads[info.head_idx] = new_node_idx;
+	*depth = path_length + 1;
 
-			if(node->type != QUADTREE_NODE_TYPE_LEAF)
-			{
-				uint32_t total = 0;
-				bool possible = true;
+	half_extent_t extent = qt->half_extent;
 
-				for(uint32_t i = 0; i < 4; ++i)
-				{
-					uint32_t node_idx = node->heads[i];
-					quadtree_node_t* node = nodes + node_idx;
+	while(path_length)
+	{
+		uint32_t head_idx = path[--path_length];
 
-					if(node->type != QUADTREE_NODE_TYPE_LEAF)
-					{
-						possible = false;
-						break;
-					}
+		float half_w = extent.w * 0.5f;
+		float half_h = extent.h * 0.5f;
 
-					total += node->count;
-				}
+		extent =
+		(half_extent_t)
+		{
+			.x = extent.x + ((head_idx & 2) ? half_w : -half_w),
+			.y = extent.y + ((head_idx & 1) ? half_h : -half_h),
+			.w = half_w,
+			.h = half_h
+		};
+	}
 
-				if(possible && total <= qt->merge_threshold)
-				{
-					uint32_t heads[4];
-					memcpy(heads, node->heads, sizeof(heads));
+	return extent;
+}
 
-					quadtree_node_t* children[4];
-					for(uint32_t i = 0; i < 4; ++i)
-					{
-						children[i] = nodes + heads[i];
-					}
 
-					node->head = 0;
-					node->position_flags = 0;
-					node->count = 0;
-					node->type = QUADTREE_NODE_TYPE_LEAF;
+void
+quadtree_normalize_dirty(
+	quadtree_t* qt,
+	uint32_t node_entities_base,
+	uint32_t free_node_entity
+	)
+{
+	quadtree_node_t* nodes = qt->nodes;
+	uint32_t* node_parents = qt->node_parents;
+	quadtree_node_entities_t node_entities = qt->node_entities;
+	quadtree_entity_t* entities = qt->entities;
 
-					rect_extent_t node_extent = half_to_rect_extent(info.extent);
+	uint32_t free_node = qt->free_node;
+	uint32_t nodes_used = qt->nodes_used;
+	uint32_t nodes_size = qt->nodes_size;
 
-					uint32_t merge_indexes[qt->merge_threshold];
-					uint32_t merge_count = 0;
+	uint32_t node_entities_used = qt->node_entities_used;
+	uint32_t node_entities_size = qt->node_entities_size;
 
-					for(uint32_t i = 0; i < 4; ++i)
-					{
-						uint32_t child_idx = heads[i];
-						quadtree_node_t* child = children[i];
+	/* Leaves the update only moved entities within, before splits and merges shift the nodes around */
+	quadtree_node_sums_fix_stale(qt);
 
-						node->position_flags |= child->position_flags;
 
-						uint32_t node_entity_idx = child->head;
-						while(node_entity_idx)
-						{
-							uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
-							quadtree_entity_t* entity = entities + entity_idx;
+	for(uint32_t dirty_node_idx = 0; dirty_node_idx < qt->dirty_nodes_used; ++dirty_node_idx)
+	{
+		uint32_t node_idx = qt->dirty_nodes[dirty_node_idx].node_idx;
+		quadtree_node_t* node = nodes + node_idx;
 
-							uint32_t next_node_entity_idx = node_entities.next[node_entity_idx];
-							bool is_duplicate = false;
+		if(node->type != QUADTREE_NODE_TYPE_LEAF || !(node->position_flags & QUADTREE_NODE_DIRTY))
+		{
+			continue;
+		}
 
-							if(entity->in_nodes_minus_one)
-							{
-								for(uint32_t j = 0; j < merge_count; ++j)
-								{
-									if(merge_indexes[j] == entity_idx)
-									{
-										is_duplicate = true;
-										break;
-									}
-								}
-							}
+		uint32_t depth;
+		half_extent_t extent = quadtree_node_extent(qt, node_idx, &depth);
 
-							if(!is_duplicate)
-							{
-								merge_indexes[merge_count++] = entity_idx;
+#if QUADTREE_BRANCH_ENTITIES == 1
+		bool spill = node_idx && node_idx == nodes[node_parents[node_idx]].children + 4;
+#else
+		bool spill = false;
+#endif
 
-								node_entities.next[node_entity_idx] = node->head;
-								node_entities.entities[node_entity_idx].is_last = !node->head;
-								node->head = node_entity_idx;
+		if(
+			!spill &&
+			node->count >= qt->split_threshold &&
+			extent.w >= qt->min_size &&
+			extent.h >= qt->min_size &&
+			depth < qt->max_depth
+			)
+		{
+			uint32_t children_idx;
 
-								rect_extent_t entity_extent = quadtree_get_entity_rect_extent(entity);
-								quadtree_reset_flags();
+			if(free_node)
+			{
+				children_idx = free_node;
+				free_node = nodes[children_idx].next;
+			}
+			else
+			{
+				if(nodes_used + QUADTREE_NODE_BLOCK > nodes_size)
+				{
+					uint32_t new_size = ((nodes_used + QUADTREE_NODE_BLOCK) << 1) | 3;
 
-								++node->count;
-							}
-							else
-							{
-								node_entities.next[node_entity_idx] = free_node_entity;
-								free_node_entity = node_entity_idx;
+					nodes = quadtree_heap_call(alloc_remalloc(nodes, nodes_size, new_size));
+					assert_not_null(nodes);
 
-								--entity->in_nodes_minus_one;
-								if(entity_map[entity_idx])
-								{
-									new_entities[entity_map[entity_idx]].in_nodes_minus_one = entity->in_nodes_minus_one;
-								}
-							}
+					node_parents = quadtree_heap_call(alloc_remalloc(node_parents, nodes_size, new_size));
+					assert_not_null(node_parents);
 
-							node_entity_idx = next_node_entity_idx;
-						}
+					nodes_size = new_size;
 
-						child->next = free_node;
-						free_node = child_idx;
-					}
+					qt->nodes = nodes;
+					qt->node_parents = node_parents;
 
-					qt->normalization |= QUADTREE_NOT_NORMALIZED_SOFT;
+					node = nodes + node_idx;
 				}
+
+				children_idx = nodes_used;
+				nodes_used += QUADTREE_NODE_BLOCK;
 			}
-			else if(
-				node->count >= qt->split_threshold &&
-				info.extent.w >= qt->min_size &&
-				info.extent.h >= qt->min_size &&
-				info.depth < qt->max_depth
-				)
-			{
-				uint32_t child_idxs[4];
-				for(uint32_t i = 0; i < 4; ++i)
-				{
-					uint32_t child_idx;
 
-					if(free_node)
-					{
-						child_idx = free_node;
-						free_node = nodes[child_idx].next;
-					}
-					else
-					{
-						if(nodes_used >= nodes_size)
-						{
-							uint32_t new_size = (nodes_used << 1) | 3;
-							assert_neq(new_size, nodes_size);
+			quadtree_node_t* children[QUADTREE_NODE_BLOCK];
+			uint32_t head = node->head;
+			uint32_t position_flags = node->position_flags;
 
-							nodes = alloc_remalloc(nodes, nodes_size, new_size);
-							assert_not_null(nodes);
+			node->children = children_idx;
+			node->type = QUADTREE_NODE_TYPE_BRANCH;
 
-							nodes_size = new_size;
+#if QUADTREE_BRANCH_ENTITIES == 1
+			children[4] = nodes + children_idx + 4;
+			node_parents[children_idx + 4] = node_idx;
 
-							node = nodes + info.node_idx;
+			children[4]->head = 0;
+			children[4]->count = 0;
+			children[4]->type = QUADTREE_NODE_TYPE_LEAF;
+			children[4]->position_flags = (position_flags & 0b1111) | QUADTREE_NODE_DIRTY;
 
+			quadtree_dirty_push(qt, children_idx + 4, 0, 0);
+#endif
 
-							if(new_size > new_nodes_size)
-							{
-								new_nodes = alloc_remalloc(new_nodes, new_nodes_size, new_size);
-								assert_not_null(new_nodes);
+			for(uint32_t i = 0; i < 4; ++i)
+			{
+				uint32_t child_idx = children_idx + i;
+				quadtree_node_t* child = nodes + child_idx;
+				children[i] = child;
 
-								new_nodes_size = new_size;
+				node_parents[child_idx] = node_idx;
 
-								new_node = new_nodes + new_node_idx;
-							}
-						}
+				child->head = 0;
+				child->count = 0;
+				child->type = QUADTREE_NODE_TYPE_LEAF;
 
-						child_idx = nodes_used++;
-					}
+				static const uint32_t position_flags_mask[4] =
+				{
+					0b0011,
+					0b1001,
+					0b0110,
+					0b1100
+				};
 
-					child_idxs[i] = child_idx;
-				}
+				child->position_flags = (position_flags & position_flags_mask[i]) | QUADTREE_NODE_DIRTY;
 
-				quadtree_node_t* children[4];
-				uint32_t head = node->head;
-				uint32_t position_flags = node->position_flags;
+				quadtree_dirty_push(qt, child_idx, 0, 0);
+			}
 
-				for(uint32_t i = 0; i < 4; ++i)
-				{
-					uint32_t child_idx = child_idxs[i];
-					quadtree_node_t* child = nodes + child_idx;
-					children[i] = child;
+			uint32_t node_entity_idx = head;
+			while(node_entity_idx)
+			{
+				uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
+				quadtree_entity_t* entity = entities + entity_idx;
 
-					node->heads[i] = child_idx;
+#if QUADTREE_LOOSE == 1
+				/* The entity may have left its loose extent without entering any new node */
+				quadtree_loose_widen(qt, entity, entity_idx);
+#endif
+				rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
 
-					child->head = 0;
-					child->count = 0;
-					child->type = QUADTREE_NODE_TYPE_LEAF;
+				uint32_t target_node_idxs[4];
+				uint32_t* current_target_node_idx = target_node_idxs;
 
-					static const uint32_t position_flags_mask[4] =
+				if(entity_extent.min_x <= extent.x)
+				{
+					if(entity_extent.min_y <= extent.y)
 					{
-						0b0011,
-						0b1001,
-						0b0110,
-						0b1100
-					};
-
-					child->position_flags = position_flags & position_flags_mask[i];
+						*(current_target_node_idx++) = 0;
+					}
+					if(entity_extent.max_y >= extent.y)
+					{
+						*(current_target_node_idx++) = 1;
+					}
+				}
+				if(entity_extent.max_x >= extent.x)
+				{
+					if(entity_extent.min_y <= extent.y)
+					{
+						*(current_target_node_idx++) = 2;
+					}
+					if(entity_extent.max_y >= extent.y)
+					{
+						*(current_target_node_idx++) = 3;
+					}
 				}
 
-				uint32_t node_entity_idx = head;
-				while(node_entity_idx)
+#if QUADTREE_BRANCH_ENTITIES == 1
+				if(quadtree_branch_holds(qt, entity_extent, extent))
 				{
-					uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
-					quadtree_entity_t* entity = entities + entity_idx;
+					current_target_node_idx = target_node_idxs;
+					*(current_target_node_idx++) = 4;
+				}
+#endif
 
-					rect_extent_t entity_extent = quadtree_get_entity_rect_extent(entity);
+				entity->in_nodes_minus_one += current_target_node_idx - target_node_idxs - 1;
 
-					uint32_t target_node_idxs[4];
-					uint32_t* current_target_node_idx = target_node_idxs;
+				for(uint32_t* target_node_idx = target_node_idxs; target_node_idx != current_target_node_idx; ++target_node_idx)
+				{
+					quadtree_node_t* target_node = children[*target_node_idx];
 
-					if(entity_extent.min_x <= info.extent.x)
+					uint32_t new_node_entity_idx;
+
+					if(free_node_entity)
 					{
-						if(entity_extent.min_y <= info.extent.y)
-						{
-							*(current_target_node_idx++) = 0;
-						}
-						if(entity_extent.max_y >= info.extent.y)
-						{
-							*(current_target_node_idx++) = 1;
-						}
+						new_node_entity_idx = free_node_entity;
+						free_node_entity = node_entities.next[new_node_entity_idx];
 					}
-					if(entity_extent.max_x >= info.extent.x)
+					else
 					{
-						if(entity_extent.min_y <= info.extent.y)
-						{
-							*(current_target_node_idx++) = 2;
-						}
-						if(entity_extent.max_y >= info.extent.y)
+						if(node_entities_used >= node_entities_size)
 						{
-							*(current_target_node_idx++) = 3;
+							uint32_t new_size = (node_entities_used << 1) | 3;
+							assert_neq(new_size, node_entities_size);
+
+							node_entities.next = quadtree_heap_call(alloc_remalloc(node_entities.next, node_entities_size, new_size));
+							assert_not_null(node_entities.next);
+
+							node_entities.entities = quadtree_heap_call(alloc_remalloc(node_entities.entities, node_entities_size, new_size));
+							assert_not_null(node_entities.entities);
+
+							node_entities.flags = quadtree_heap_call(alloc_remalloc(node_entities.flags, node_entities_size, new_size));
+							assert_not_null(node_entities.flags);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+							node_entities.links = quadtree_heap_call(alloc_remalloc(node_entities.links, node_entities_size, new_size));
+							assert_not_null(node_entities.links);
+#endif
+
+							node_entities_size = new_size;
 						}
-					}
 
-					entity->in_nodes_minus_one += current_target_node_idx - target_node_idxs - 1;
-					if(entity_map[entity_idx])
-					{
-						new_entities[entity_map[entity_idx]].in_nodes_minus_one = entity->in_nodes_minus_one;
+						new_node_entity_idx = node_entities_used++;
 					}
 
-					for(uint32_t* target_node_idx = target_node_idxs; target_node_idx != current_target_node_idx; ++target_node_idx)
-					{
-						quadtree_node_t* target_node = children[*target_node_idx];
+					node_entities.next[new_node_entity_idx] = target_node->head;
+					node_entities.entities[new_node_entity_idx].index = entity_idx;
+					quadtree_set_node_entity_extent(node_entities.entities + new_node_entity_idx,
+						quadtree_entity_extent(qt, entity, entity_idx), quadtree_child_rect_extent(extent, *target_node_idx));
+					node_entities.flags[new_node_entity_idx] = node_entities.flags[node_entity_idx];
+					target_node->head = new_node_entity_idx;
 
-						uint32_t new_node_entity_idx;
+					++target_node->count;
+				}
 
-						if(free_node_entity)
-						{
-							new_node_entity_idx = free_node_entity;
-							free_node_entity = node_entities.next[new_node_entity_idx];
-						}
-						else
-						{
-							if(node_entities_used >= node_entities_size)
-							{
-								uint32_t new_size = (node_entities_used << 1) | 3;
-								assert_neq(new_size, node_entities_size);
+				uint32_t next_node_entity_idx = node_entities.next[node_entity_idx];
 
-								node_entities.next = alloc_remalloc(node_entities.next, node_entities_size, new_size);
-								assert_not_null(node_entities.next);
+				node_entities.next[node_entity_idx] = free_node_entity;
+				free_node_entity = node_entity_idx;
 
-								node_entities.entities = alloc_remalloc(node_entities.entities, node_entities_size, new_size);
-								assert_not_null(node_entities.entities);
+				node_entity_idx = next_node_entity_idx;
+			}
 
-								node_entities.flags = alloc_remalloc(node_entities.flags, node_entities_size, new_size);
-								assert_not_null(node_entities.flags);
+			continue;
+		}
 
-								node_entities_size = new_size;
+		if(!node_idx)
+		{
+			continue;
+		}
 
-								if(new_size > new_node_entities_size)
-								{
-									new_node_entities.next = alloc_remalloc(new_node_entities.next, new_node_entities_size, new_size);
-									assert_not_null(new_node_entities.next);
+		uint32_t parent_idx = node_parents[node_idx];
+		quadtree_node_t* parent = nodes + parent_idx;
 
-									new_node_entities.entities = alloc_remalloc(new_node_entities.entities, new_node_entities_size, new_size);
-									assert_not_null(new_node_entities.entities);
+		uint32_t total = 0;
+		bool possible = true;
 
-									new_node_entities.flags = alloc_remalloc(new_node_entities.flags, new_node_entities_size, new_size);
-									assert_not_null(new_node_entities.flags);
+		for(uint32_t i = 0; i < 4; ++i)
+		{
+			quadtree_node_t* child = nodes + parent->children + i;
 
-									new_node_entities_size = new_size;
-								}
-							}
+			if(child->type != QUADTREE_NODE_TYPE_LEAF)
+			{
+				possible = false;
+				break;
+			}
 
-							new_node_entity_idx = node_entities_used++;
-						}
+			total += child->count;
+		}
 
-						node_entities.next[new_node_entity_idx] = target_node->head;
-						node_entities.entities[new_node_entity_idx].is_last = !target_node->head;
-						node_entities.entities[new_node_entity_idx].index = entity_idx;
-						node_entities.flags[new_node_entity_idx] = node_entities.flags[node_entity_idx];
-						target_node->head = new_node_entity_idx;
+#if QUADTREE_BRANCH_ENTITIES == 1
+		total += nodes[parent->children + 4].count;
+#endif
 
-						++target_node->count;
-					}
+		if(!possible || total > qt->merge_threshold)
+		{
+			continue;
+		}
 
-					uint32_t next_node_entity_idx = node_entities.next[node_entity_idx];
+		uint32_t children_idx = parent->children;
 
-					node_entities.next[node_entity_idx] = free_node_entity;
-					free_node_entity = node_entity_idx;
+		quadtree_node_t* children[QUADTREE_NODE_BLOCK];
+		for(uint32_t i = 0; i < QUADTREE_NODE_BLOCK; ++i)
+		{
+			children[i] = nodes + children_idx + i;
 
-					node_entity_idx = next_node_entity_idx;
-				}
-			}
+			node = children[i];
+			quadtree_mark_dirty(children_idx + i);
+		}
 
-			if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		node = parent;
+
+		node->head = 0;
+		node->position_flags = 0;
+		node->count = 0;
+		node->type = QUADTREE_NODE_TYPE_LEAF;
+
+		rect_extent_t node_extent = half_to_rect_extent(quadtree_node_extent(qt, parent_idx, &depth));
+
+		uint32_t merge_indexes[qt->merge_threshold];
+		uint32_t merge_count = 0;
+
+		for(uint32_t i = 0; i < QUADTREE_NODE_BLOCK; ++i)
+		{
+			quadtree_node_t* child = children[i];
+
+			node->position_flags |= child->position_flags & 0b1111; /* TRBL */
+
+			uint32_t node_entity_idx = child->head;
+			while(node_entity_idx)
 			{
-				float half_w = info.extent.w * 0.5f;
-				float half_h = info.extent.h * 0.5f;
-				uint32_t next_depth = info.depth + 1;
+				uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
+				quadtree_entity_t* entity = entities + entity_idx;
 
-				*(node_info++) =
-				(quadtree_node_reorder_info_t)
+				uint32_t next_node_entity_idx = node_entities.next[node_entity_idx];
+				bool is_duplicate = false;
+
+				if(entity->in_nodes_minus_one)
 				{
-					.node_idx = node->heads[0],
-					.extent =
-					(half_extent_t)
+					for(uint32_t j = 0; j < merge_count; ++j)
 					{
-						.x = info.extent.x - half_w,
-						.y = info.extent.y - half_h,
-						.w = half_w,
-						.h = half_h
-					},
-					.parent_node_idx = new_node_idx,
-					.head_idx = 0,
-					.depth = next_depth
-				};
+						if(merge_indexes[j] == entity_idx)
+						{
+							is_duplicate = true;
+							break;
+						}
+					}
+				}
 
-				*(node_info++) =
-				(quadtree_node_reorder_info_t)
+				if(!is_duplicate)
 				{
-					.node_idx = node->heads[1],
-					.extent =
-					(half_extent_t)
-					{
-						.x = info.extent.x - half_w,
-						.y = info.extent.y + half_h,
-						.w = half_w,
-						.h = half_h
-					},
-					.parent_node_idx = new_node_idx,
-					.head_idx = 1,
-					.depth = next_depth
-				};
+					merge_indexes[merge_count++] = entity_idx;
 
-				*(node_info++) =
-				(quadtree_node_reorder_info_t)
-				{
-					.node_idx = node->heads[2],
-					.extent =
-					(half_extent_t)
-					{
-						.x = info.extent.x + half_w,
-						.y = info.extent.y - half_h,
-						.w = half_w,
-						.h = half_h
-					},
-					.parent_node_idx = new_node_idx,
-					.head_idx = 2,
-					.depth = next_depth
-				};
+					node_entities.next[node_entity_idx] = node->head;
+					node->head = node_entity_idx;
 
-				*(node_info++) =
-				(quadtree_node_reorder_info_t)
-				{
-					.node_idx = node->heads[3],
-					.extent =
-					(half_extent_t)
-					{
-						.x = info.extent.x + half_w,
-						.y = info.extent.y + half_h,
-						.w = half_w,
-						.h = half_h
-					},
-					.parent_node_idx = new_node_idx,
-					.head_idx = 3,
-					.depth = next_depth
-				};
-			}
-			else
-			{
-				new_node->position_flags = node->position_flags;
-				new_node->type = QUADTREE_NODE_TYPE_LEAF;
+#if QUADTREE_NODE_ENTITY_EXTENT == 2
+					/* Quantized relative to the child it came from */
+					quadtree_set_node_entity_extent(node_entities.entities + node_entity_idx,
+						quadtree_entity_extent(qt, entity, entity_idx), node_extent);
+#endif
+					rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+					quadtree_reset_flags();
 
-				if(!node->head)
+					++node->count;
+				}
+				else
 				{
-					new_node->head = 0;
-					new_node->count = 0;
+					node_entities.next[node_entity_idx] = free_node_entity;
+					free_node_entity = node_entity_idx;
 
-					continue;
+					--entity->in_nodes_minus_one;
 				}
 
-				uint32_t node_entity_idx = node->head;
+				node_entity_idx = next_node_entity_idx;
+			}
 
-				new_node->head = new_node_entities_used;
-				new_node->count = node->count;
+			child->position_flags = 0;
+		}
 
-				while(1)
-				{
-					uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
-					if(!entity_map[entity_idx])
-					{
-						uint32_t new_entity_idx = new_entities_used++;
-						entity_map[entity_idx] = new_entity_idx;
-						new_entities[new_entity_idx] = entities[entity_idx];
-					}
+		children[0]->next = free_node;
+		free_node = children_idx;
 
-					uint32_t new_entity_idx = entity_map[entity_idx];
-					new_node_entities.entities[new_node_entities_used].index = new_entity_idx;
-					new_node_entities.flags[new_node_entities_used] = node_entities.flags[node_entity_idx];
+		node->position_flags |= QUADTREE_NODE_DIRTY;
+		quadtree_dirty_push(qt, parent_idx, 0, 0);
+	}
 
-					if(node_entities.next[node_entity_idx])
-					{
-						node_entity_idx = node_entities.next[node_entity_idx];
-						new_node_entities.entities[new_node_entities_used].is_last = false;
-						new_node_entities.next[new_node_entities_used] = new_node_entities_used + 1;
-						++new_node_entities_used;
-					}
-					else
-					{
-						new_node_entities.entities[new_node_entities_used].is_last = true;
-						new_node_entities.next[new_node_entities_used] = 0;
-						++new_node_entities_used;
-						break;
-					}
-				}
+
+	uint32_t gathered_size = 0;
+
+	for(uint32_t dirty_node_idx = 0; dirty_node_idx < qt->dirty_nodes_used; ++dirty_node_idx)
+	{
+		quadtree_node_t* node = nodes + qt->dirty_nodes[dirty_node_idx].node_idx;
+
+		if(node->type == QUADTREE_NODE_TYPE_LEAF && (node->position_flags & QUADTREE_NODE_DIRTY))
+		{
+			gathered_size += node->count;
+		}
+	}
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+	if(qt->gathered_size < gathered_size)
+	{
+		uint32_t new_size = (gathered_size << 1) | 3;
+
+		alloc_free(qt->gathered_entities, qt->gathered_size);
+		qt->gathered_entities = quadtree_heap_call(alloc_malloc(qt->gathered_entities, new_size));
+		assert_not_null(qt->gathered_entities);
+
+		alloc_free(qt->gathered_flags, qt->gathered_size);
+		qt->gathered_flags = quadtree_heap_call(alloc_malloc(qt->gathered_flags, new_size));
+		assert_not_null(qt->gathered_flags);
+
+		qt->gathered_size = new_size;
+	}
+
+	quadtree_node_entity_t* gathered_entities = qt->gathered_entities;
+	uint8_t* gathered_flags = qt->gathered_flags;
+#else
+	quadtree_node_entity_t* gathered_entities = quadtree_heap_call(alloc_malloc(gathered_entities, gathered_size));
+	assert_ptr(gathered_entities, gathered_size);
+
+	uint8_t* gathered_flags = quadtree_heap_call(alloc_malloc(gathered_flags, gathered_size));
+	assert_ptr(gathered_flags, gathered_size);
+#endif
+
+	uint32_t gathered_used = 0;
+
+	for(uint32_t dirty_node_idx = 0; dirty_node_idx < qt->dirty_nodes_used; ++dirty_node_idx)
+	{
+		quadtree_dirty_node_t* dirty_node = qt->dirty_nodes + dirty_node_idx;
+		quadtree_node_t* node = nodes + dirty_node->node_idx;
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF || !(node->position_flags & QUADTREE_NODE_DIRTY))
+		{
+			dirty_node->node_idx = UINT32_MAX;
+			continue;
+		}
+
+		node->position_flags &= ~QUADTREE_NODE_DIRTY;
+
+		uint32_t node_entity_idx = node->head;
+		node->head = gathered_used;
+
+		while(node_entity_idx)
+		{
+			gathered_entities[gathered_used] = node_entities.entities[node_entity_idx];
+			gathered_flags[gathered_used] = node_entities.flags[node_entity_idx];
+			++gathered_used;
+
+			node_entity_idx = node_entities.next[node_entity_idx];
+		}
+
+		assert_eq(gathered_used - node->head, node->count);
+	}
+
+	uint32_t holes = qt->node_entities_holes;
+
+	for(uint32_t dirty_node_idx = 0; dirty_node_idx < qt->dirty_nodes_used; ++dirty_node_idx)
+	{
+		quadtree_dirty_node_t* dirty_node = qt->dirty_nodes + dirty_node_idx;
+
+		uint32_t node_entity_idx = dirty_node->head;
+		uint32_t node_entity_end = node_entity_idx + dirty_node->count;
+
+		for(; node_entity_idx != node_entity_end; ++node_entity_idx)
+		{
+			node_entities.next[node_entity_idx] = 0;
+			node_entities.entities[node_entity_idx].index = 0;
+			node_entities.entities[node_entity_idx].is_last = true;
+		}
+
+		holes += dirty_node->count;
+	}
+
+	node_entities_used = node_entities_base;
+
+	for(uint32_t dirty_node_idx = 0; dirty_node_idx < qt->dirty_nodes_used; ++dirty_node_idx)
+	{
+		quadtree_dirty_node_t* dirty_node = qt->dirty_nodes + dirty_node_idx;
+
+		if(dirty_node->node_idx == UINT32_MAX)
+		{
+			continue;
+		}
+
+		quadtree_node_t* node = nodes + dirty_node->node_idx;
+
+		if(!node->count)
+		{
+			node->head = 0;
+			continue;
+		}
+
+		uint32_t gathered_idx = node->head;
+		uint32_t node_entity_idx;
+
+		if(node->count <= dirty_node->count)
+		{
+			node_entity_idx = dirty_node->head;
+			holes -= node->count;
+		}
+		else
+		{
+			if(node_entities_used + node->count > node_entities_size)
+			{
+				uint32_t new_size = ((node_entities_used + node->count) << 1) | 3;
+
+				node_entities.next = quadtree_heap_call(alloc_remalloc(node_entities.next, node_entities_size, new_size));
+				assert_not_null(node_entities.next);
+
+				node_entities.entities = quadtree_heap_call(alloc_remalloc(node_entities.entities, node_entities_size, new_size));
+				assert_not_null(node_entities.entities);
+
+				node_entities.flags = quadtree_heap_call(alloc_remalloc(node_entities.flags, node_entities_size, new_size));
+				assert_not_null(node_entities.flags);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+				node_entities.links = quadtree_heap_call(alloc_remalloc(node_entities.links, node_entities_size, new_size));
+				assert_not_null(node_entities.links);
+#endif
+
+				node_entities_size = new_size;
 			}
+
+			node_entity_idx = node_entities_used;
+			node_entities_used += node->count;
 		}
-		while(node_info != node_infos);
 
-		alloc_free(nodes, nodes_size);
-		qt->nodes = new_nodes;
-		qt->nodes_used = new_nodes_used;
-		qt->nodes_size = new_nodes_size;
+		node->head = node_entity_idx;
 
-		alloc_free(node_entities.next, node_entities_size);
-		alloc_free(node_entities.entities, node_entities_size);
-		alloc_free(node_entities.flags, node_entities_size);
-		qt->node_entities = new_node_entities;
-		qt->node_entities_used = new_node_entities_used;
-		qt->node_entities_size = new_node_entities_size;
+		uint32_t node_entity_end = node_entity_idx + node->count - 1;
 
-		alloc_free(entities, entities_size);
-		qt->entities = new_entities;
-		qt->entities_used = new_entities_used;
-		qt->entities_size = new_entities_size;
+		for(; node_entity_idx != node_entity_end; ++node_entity_idx, ++gathered_idx)
+		{
+			node_entities.next[node_entity_idx] = node_entity_idx + 1;
+			node_entities.entities[node_entity_idx] = gathered_entities[gathered_idx];
+			node_entities.entities[node_entity_idx].is_last = false;
+			node_entities.flags[node_entity_idx] = gathered_flags[gathered_idx];
+		}
 
-		alloc_free(entity_map, entities_size);
+		node_entities.next[node_entity_idx] = 0;
+		node_entities.entities[node_entity_idx] = gathered_entities[gathered_idx];
+		node_entities.entities[node_entity_idx].is_last = true;
+		node_entities.flags[node_entity_idx] = gathered_flags[gathered_idx];
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+		quadtree_link_node_entities(entities, node_entities, dirty_node->node_idx, node->head, node->count);
+#endif
 	}
-}
 
+#if QUADTREE_SCRATCH_ARENAS == 0
+	alloc_free(gathered_flags, gathered_size);
+	alloc_free(gathered_entities, gathered_size);
+#endif
 
-void
-quadtree_normalize_hard(
-	quadtree_t* qt
-	)
-{
-	assert_not_null(qt);
+	qt->nodes_used = nodes_used;
+	qt->nodes_size = nodes_size;
+	qt->free_node = free_node;
 
-	if(qt->normalization <= QUADTREE_NOT_NORMALIZED_SOFT)
+	qt->node_entities = node_entities;
+	qt->node_entities_used = node_entities_used;
+	qt->node_entities_size = node_entities_size;
+	qt->node_entities_holes = holes;
+
+	if(qt->node_sums_valid)
 	{
-		return;
+		quadtree_node_sums_reserve(qt, nodes_size);
+
+		for(uint32_t dirty_node_idx = 0; dirty_node_idx < qt->dirty_nodes_used; ++dirty_node_idx)
+		{
+			uint32_t node_idx = qt->dirty_nodes[dirty_node_idx].node_idx;
+
+			if(node_idx == UINT32_MAX)
+			{
+				continue;
+			}
+
+			uint32_t depth;
+			half_extent_t extent = quadtree_node_extent(qt, node_idx, &depth);
+
+			quadtree_node_sums_fix(qt, node_idx, extent.x, extent.y);
+		}
 	}
 
-	quadtree_normalize(qt);
+	qt->dirty_nodes_used = 0;
+}
+
+
+#endif
+
+
+int
+quadtree_node_removal_cmp(
+	const void* a,
+	const void* b
+	)
+{
+	const quadtree_node_removal_t* node_removal_a = a;
+	const quadtree_node_removal_t* node_removal_b = b;
+
+	return
+		(node_removal_a->node_entity_idx > node_removal_b->node_entity_idx) -
+		(node_removal_a->node_entity_idx < node_removal_b->node_entity_idx);
 }
 
 
 void
-quadtree_update(
-	quadtree_t* qt,
-	quadtree_update_fn_t update_fn,
-	void* user_data
+quadtree_normalize(
+	quadtree_t* qt
 	)
 {
 	assert_not_null(qt);
-	assert_not_null(update_fn);
 
-	quadtree_normalize_hard(qt);
+	if(qt->normalization == QUADTREE_NORMALIZED)
+	{
+		return;
+	}
 
-	qt->update_tick ^= 1;
-	uint32_t update_tick = qt->update_tick;
+	qt->normalization = QUADTREE_NORMALIZED;
 
 	quadtree_node_t* nodes = qt->nodes;
-	uint32_t* node_entities_next = qt->node_entities.next;
-	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
-	uint8_t* node_entities_flags = qt->node_entities.flags;
-	uint8_t* node_entities_flags_copy = node_entities_flags;
+	quadtree_node_entities_t node_entities = qt->node_entities;
 	quadtree_entity_t* entities = qt->entities;
-	quadtree_reinsertion_t* reinsertions = qt->reinsertions;
-	quadtree_node_removal_t* node_removals = qt->node_removals;
 
-	uint32_t reinsertions_used = qt->reinsertions_used;
-	uint32_t reinsertions_size = qt->reinsertions_size;
+	uint32_t free_node_entity = 0;
+	uint32_t node_entities_used = qt->node_entities_used;
+	uint32_t node_entities_size = qt->node_entities_size;
 
-	uint32_t node_removals_used = qt->node_removals_used;
-	uint32_t node_removals_size = qt->node_removals_size;
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	uint32_t node_entities_base = node_entities_used;
+	uint32_t free_entity = qt->free_entity;
+#else
+	uint32_t free_entity = 0;
+#endif
+	uint32_t entities_used = qt->entities_used;
+	uint32_t entities_size = qt->entities_size;
 
 	quadtree_node_info_t node_infos[qt->dfs_length];
-	quadtree_node_info_t* node_info = node_infos;
+	quadtree_node_info_t* node_info;
 
-	*(node_info++) =
-	(quadtree_node_info_t)
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	if(qt->removals_used)
+	{
+		/* Removed entities leave through their node entities, alongside those the update dropped */
+		quadtree_removal_t* removal = qt->removals;
+		quadtree_removal_t* removal_end = removal + qt->removals_used;
+
+		uint32_t node_removals_used = qt->node_removals_used;
+
+		for(; removal != removal_end; ++removal)
+		{
+			uint32_t entity_idx = removal->entity_idx;
+			uint32_t node_entity_idx = entities[entity_idx].node_entity;
+
+			while(node_entity_idx)
+			{
+				if(node_removals_used >= qt->node_removals_size)
+				{
+					uint32_t new_size = (node_removals_used << 1) | 3;
+					assert_neq(new_size, qt->node_removals_size);
+
+					qt->node_removals = quadtree_heap_call(alloc_remalloc(qt->node_removals, qt->node_removals_size, new_size));
+					assert_not_null(qt->node_removals);
+
+					qt->node_removals_size = new_size;
+				}
+
+				qt->node_removals[node_removals_used++] =
+				(quadtree_node_removal_t)
+				{
+					.node_idx = node_entities.links[node_entity_idx].node_idx,
+					.node_entity_idx = node_entity_idx,
+					.entity_idx = entity_idx
+				};
+
+				node_entity_idx = node_entities.links[node_entity_idx].next;
+			}
+		}
+
+		qt->node_removals_used = node_removals_used;
+
+		qsort(qt->node_removals, node_removals_used,
+			sizeof(*qt->node_removals), quadtree_node_removal_cmp);
+	}
+#endif
+
+	if(qt->node_removals_used)
+	{
+		quadtree_node_removal_t* node_removals = qt->node_removals;
+		quadtree_node_removal_t* node_removal_end = node_removals + qt->node_removals_used;
+		quadtree_node_removal_t* node_removal = node_removal_end - 1;
+
+		while(node_removal >= node_removals)
+		{
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+			/* The entity may have left this node in its update before being removed */
+			if(node_removal + 1 != node_removal_end &&
+				node_removal[1].node_entity_idx == node_removal->node_entity_idx)
+			{
+				--node_removal;
+				continue;
+			}
+#endif
+
+			uint32_t node_idx = node_removal->node_idx;
+			quadtree_node_t* node = nodes + node_idx;
+
+			uint32_t node_entity_idx = node_removal->node_entity_idx;
+			uint32_t* node_entity_next = node_entities.next + node_entity_idx;
+			uint32_t entity_idx = node_removal->entity_idx;
+
+			uint32_t next = *node_entity_next;
+			quadtree_entity_t* entity = entities + entity_idx;
+
+			quadtree_mark_dirty(node_idx);
+
+			if(node->head != node_entity_idx)
+			{
+				*(node_entity_next - 1) = next;
+				if(!next)
+				{
+					node_entities.entities[node_entity_idx - 1].is_last = true;
+				}
+			}
+			else
+			{
+				node->head = next;
+			}
+
+			--node->count;
+			--entity->in_nodes_minus_one;
+
+			*node_entity_next = free_node_entity;
+			free_node_entity = node_entity_idx;
+
+			--node_removal;
+		}
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+		qt->node_removals_used = 0;
+#else
+		alloc_free(node_removals, qt->node_removals_size);
+		qt->node_removals = NULL;
+		qt->node_removals_used = 0;
+		qt->node_removals_size = 0;
+#endif
+	}
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	for(uint32_t removal_idx = 0; removal_idx < qt->removals_used; ++removal_idx)
+	{
+		entities[qt->removals[removal_idx].entity_idx].node_entity = UINT32_MAX;
+	}
+#endif
+
+
+	{
+		quadtree_reinsertion_t* reinsertions = qt->reinsertions;
+		quadtree_reinsertion_t* reinsertion = reinsertions;
+		quadtree_reinsertion_t* reinsertion_end = reinsertion + qt->reinsertions_used;
+
+#if QUADTREE_LOOSE == 1
+		typedef struct quadtree_loose_node_info
+		{
+			uint32_t node_idx;
+			half_extent_t extent;
+			bool reached;
+		}
+		quadtree_loose_node_info_t;
+#endif
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+		/* Set below the node an entity belongs to, which is then dropped from any it is still in */
+		typedef struct quadtree_placed_node_info
+		{
+			uint32_t node_idx;
+			half_extent_t extent;
+			bool placed;
+		}
+		quadtree_placed_node_info_t;
+#else
+		typedef quadtree_node_info_t quadtree_placed_node_info_t;
+#endif
+
+		quadtree_placed_node_info_t node_infos[qt->dfs_length];
+		quadtree_placed_node_info_t* node_info;
+
+		while(reinsertion != reinsertion_end)
+		{
+			uint32_t entity_idx = reinsertion->entity_idx;
+			quadtree_entity_t* entity = entities + entity_idx;
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+			/* Removed, and already out of every node */
+			if(entity->node_entity == UINT32_MAX)
+			{
+				++reinsertion;
+				continue;
+			}
+#endif
+
+#if QUADTREE_LOOSE == 1
+			rect_extent_t old_extent = entity->loose_extent;
+			rect_extent_t exact_extent = quadtree_entity_extent(qt, entity, entity_idx);
+			entity->loose_extent = quadtree_loose_extent(qt, exact_extent, quadtree_loose_leaf_extent(qt, exact_extent));
+#endif
+			rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+			uint32_t in_nodes = 0;
+
+			/* Lists are only searched while the entity is in some node other than the one it was queued from */
+			uint32_t queued_node_idx = reinsertion->node_idx;
+			uint32_t in_nodes_left = entity->in_nodes_minus_one + !queued_node_idx;
+
+#if QUADTREE_LOOSE == 1
+			/* Nodes are only dropped here, once the new loose extent no longer reaches them */
+#undef quadtree_fill_node
+#define quadtree_fill_node(_node_idx, _extent)						\
+(quadtree_loose_node_info_t)										\
+{																	\
+	.node_idx = _node_idx,											\
+	.extent = _extent,												\
+	.reached = info.reached &&										\
+		quadtree_loose_reaches(entity_extent, info.extent, _extent)	\
+}
+
+			{
+				quadtree_loose_node_info_t node_infos[qt->dfs_length];
+				quadtree_loose_node_info_t* node_info = node_infos;
+
+				*(node_info++) =
+				(quadtree_loose_node_info_t)
+				{
+					.node_idx = 0,
+					.extent = qt->half_extent,
+					.reached = true
+				};
+
+				do
+				{
+					quadtree_loose_node_info_t info = *(--node_info);
+					quadtree_node_t* node = nodes + info.node_idx;
+
+					if(node->type != QUADTREE_NODE_TYPE_LEAF)
+					{
+						quadtree_descend(old_extent);
+						quadtree_descend_spill();
+						continue;
+					}
+
+					if(info.reached || !in_nodes_left)
+					{
+						continue;
+					}
+
+					uint32_t prev_node_entity_idx = 0;
+					uint32_t node_entity_idx = node->head;
+
+					while(node_entity_idx)
+					{
+						if(node_entities.entities[node_entity_idx].index == entity_idx)
+						{
+							quadtree_mark_dirty(info.node_idx);
+
+							if(prev_node_entity_idx)
+							{
+								node_entities.next[prev_node_entity_idx] = node_entities.next[node_entity_idx];
+								if(!node_entities.next[prev_node_entity_idx])
+								{
+									node_entities.entities[prev_node_entity_idx].is_last = true;
+								}
+							}
+							else
+							{
+								node->head = node_entities.next[node_entity_idx];
+							}
+
+							--node->count;
+							--in_nodes_left;
+
+							node_entities.next[node_entity_idx] = free_node_entity;
+							free_node_entity = node_entity_idx;
+
+							break;
+						}
+
+						prev_node_entity_idx = node_entity_idx;
+						node_entity_idx = node_entities.next[node_entity_idx];
+					}
+				}
+				while(node_info != node_infos);
+			}
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
+#endif
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+#undef quadtree_fill_node
+#define quadtree_fill_node(_node_idx, _extent, _placed)	\
+(quadtree_placed_node_info_t)							\
+{														\
+	.node_idx = _node_idx,								\
+	.extent = _extent,									\
+	.placed = _placed									\
+}
+#endif
+
+			node_info = node_infos;
+
+			*(node_info++) =
+			(quadtree_placed_node_info_t)
+			{
+				.node_idx = 0,
+				.extent = qt->half_extent
+			};
+
+			do
+			{
+				quadtree_placed_node_info_t info = *(--node_info);
+				quadtree_node_t* node = nodes + info.node_idx;
+
+				if(node->type != QUADTREE_NODE_TYPE_LEAF)
+				{
+#if QUADTREE_BRANCH_ENTITIES == 1
+					bool held = !info.placed && quadtree_branch_holds(qt, entity_extent, info.extent);
+
+					quadtree_descend(entity_extent, info.placed || held);
+
+					if(held || nodes[node->children + 4].head)
+					{
+						*(node_info++) = quadtree_fill_node(node->children + 4, info.extent, !held);
+					}
+#else
+					quadtree_descend(entity_extent);
+#endif
+					continue;
+				}
+
+				rect_extent_t node_extent = half_to_rect_extent(info.extent);
+				uint32_t node_entity_idx = node->head;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+				if(info.placed)
+				{
+					bool queued = info.node_idx == queued_node_idx;
+
+					if(!in_nodes_left && !queued)
+					{
+						continue;
+					}
+
+					uint32_t prev_node_entity_idx = 0;
+
+					while(node_entity_idx)
+					{
+						if(node_entities.entities[node_entity_idx].index == entity_idx)
+						{
+							quadtree_mark_dirty(info.node_idx);
+
+							if(prev_node_entity_idx)
+							{
+								node_entities.next[prev_node_entity_idx] = node_entities.next[node_entity_idx];
+								if(!node_entities.next[prev_node_entity_idx])
+								{
+									node_entities.entities[prev_node_entity_idx].is_last = true;
+								}
+							}
+							else
+							{
+								node->head = node_entities.next[node_entity_idx];
+							}
+
+							--node->count;
+							in_nodes_left -= !queued;
+
+							node_entities.next[node_entity_idx] = free_node_entity;
+							free_node_entity = node_entity_idx;
+
+							break;
+						}
+
+						prev_node_entity_idx = node_entity_idx;
+						node_entity_idx = node_entities.next[node_entity_idx];
+					}
+
+					continue;
+				}
+#endif
+
+				++in_nodes;
+
+				/* Its node entity already has the extent and flags the update gave it */
+				if(info.node_idx == queued_node_idx)
+				{
+					continue;
+				}
+
+				while(in_nodes_left && node_entity_idx)
+				{
+					if(node_entities.entities[node_entity_idx].index == entity_idx)
+					{
+						--in_nodes_left;
+						goto goto_skip;
+					}
+
+					node_entity_idx = node_entities.next[node_entity_idx];
+				}
+
+				quadtree_mark_dirty(info.node_idx);
+
+				if(free_node_entity)
+				{
+					node_entity_idx = free_node_entity;
+					free_node_entity = node_entities.next[node_entity_idx];
+				}
+				else
+				{
+					if(node_entities_used >= node_entities_size)
+					{
+						uint32_t new_size = (node_entities_used << 1) | 3;
+						assert_neq(new_size, node_entities_size);
+
+						node_entities.next = quadtree_heap_call(alloc_remalloc(node_entities.next, node_entities_size, new_size));
+						assert_not_null(node_entities.next);
+
+						node_entities.entities = quadtree_heap_call(alloc_remalloc(node_entities.entities, node_entities_size, new_size));
+						assert_not_null(node_entities.entities);
+
+						node_entities.flags = quadtree_heap_call(alloc_remalloc(node_entities.flags, node_entities_size, new_size));
+						assert_not_null(node_entities.flags);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+						node_entities.links = quadtree_heap_call(alloc_remalloc(node_entities.links, node_entities_size, new_size));
+						assert_not_null(node_entities.links);
+#endif
+
+						node_entities_size = new_size;
+					}
+
+					node_entity_idx = node_entities_used++;
+				}
+
+				node_entities.next[node_entity_idx] = node->head;
+				node_entities.entities[node_entity_idx].is_last = !node->head;
+				node_entities.entities[node_entity_idx].index = entity_idx;
+				quadtree_set_node_entity_extent(node_entities.entities + node_entity_idx,
+					quadtree_entity_extent(qt, entity, entity_idx), node_extent);
+				node->head = node_entity_idx;
+
+				++node->count;
+
+				goto_skip:;
+
+				quadtree_reset_flags();
+			}
+			while(node_info != node_infos);
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
+#endif
+
+			assert_neq(in_nodes, 0);
+			entity->in_nodes_minus_one = in_nodes - 1;
+
+			++reinsertion;
+		}
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+		qt->reinsertions_used = 0;
+#else
+		alloc_free(reinsertions, qt->reinsertions_size);
+		qt->reinsertions = NULL;
+		qt->reinsertions_used = 0;
+		qt->reinsertions_size = 0;
+#endif
+	}
+
+
+	{
+		quadtree_removal_t* removals = qt->removals;
+		quadtree_removal_t* removal = removals;
+		quadtree_removal_t* removal_end = removal + qt->removals_used;
+
+		while(removal != removal_end)
+		{
+			uint32_t entity_idx = removal->entity_idx;
+			quadtree_entity_t* entity = entities + entity_idx;
+
+#if QUADTREE_NODE_ENTITY_LINKS == 0
+			node_info = node_infos;
+
+			*(node_info++) =
+			(quadtree_node_info_t)
+			{
+				.node_idx = 0,
+				.extent = qt->half_extent
+			};
+
+			rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+
+			do
+			{
+				quadtree_node_info_t info = *(--node_info);
+				quadtree_node_t* node = nodes + info.node_idx;
+
+				if(node->type != QUADTREE_NODE_TYPE_LEAF)
+				{
+					quadtree_descend(entity_extent);
+					quadtree_descend_spill();
+					continue;
+				}
+
+				uint32_t prev_node_entity_idx = 0;
+				uint32_t node_entity_idx = node->head;
+
+				while(node_entity_idx)
+				{
+					if(node_entities.entities[node_entity_idx].index == entity_idx)
+					{
+						quadtree_mark_dirty(info.node_idx);
+
+						if(prev_node_entity_idx)
+						{
+							node_entities.next[prev_node_entity_idx] = node_entities.next[node_entity_idx];
+							if(!node_entities.next[prev_node_entity_idx])
+							{
+								node_entities.entities[prev_node_entity_idx].is_last = true;
+							}
+						}
+						else
+						{
+							node->head = node_entities.next[node_entity_idx];
+						}
+
+						--node->count;
+
+						node_entities.next[node_entity_idx] = free_node_entity;
+						free_node_entity = node_entity_idx;
+
+						break;
+					}
+
+					prev_node_entity_idx = node_entity_idx;
+					node_entity_idx = node_entities.next[node_entity_idx];
+				}
+			}
+			while(node_info != node_infos);
+#endif
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+			entity->in_nodes_minus_one = QUADTREE_ENTITY_FREE;
+#endif
+			quadtree_handle_free(qt, entity->handle_idx);
+
+			entity->next = free_entity;
+			free_entity = entity_idx;
+
+			++removal;
+		}
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+		qt->removals_used = 0;
+#else
+		alloc_free(removals, qt->removals_size);
+		qt->removals = NULL;
+		qt->removals_used = 0;
+		qt->removals_size = 0;
+#endif
+	}
+
+
+	{
+		quadtree_insertion_t* insertions = qt->insertions;
+		quadtree_insertion_t* insertion = insertions;
+		quadtree_insertion_t* insertion_end = insertion + qt->insertions_used;
+
+		while(insertion != insertion_end)
+		{
+#if QUADTREE_ENTITY_SOA == 1
+			quadtree_entity_data* data = qt->entity_data + insertion->handle_idx;
+#else
+			quadtree_entity_data* data = &insertion->data;
+#endif
+
+			uint32_t entity_idx;
+			quadtree_entity_t* entity;
+
+			if(free_entity)
+			{
+				entity_idx = free_entity;
+				entity = entities + entity_idx;
+				free_entity = entity->next;
+			}
+			else
+			{
+				if(entities_used >= entities_size)
+				{
+					uint32_t new_size = (entities_used << 1) | 3;
+					assert_neq(new_size, entities_size);
+
+					entities = quadtree_heap_call(alloc_remalloc(entities, entities_size, new_size));
+					assert_not_null(entities);
+
+#if QUADTREE_ENTITY_SOA == 1
+					qt->entity_extents = quadtree_heap_call(alloc_remalloc(qt->entity_extents, entities_size, new_size));
+					assert_not_null(qt->entity_extents);
+#endif
+
+					entities_size = new_size;
+				}
+
+				entity_idx = entities_used++;
+				entity = entities + entity_idx;
+			}
+
+#if QUADTREE_ENTITY_SOA == 1
+			qt->entity_extents[entity_idx] = quadtree_get_entity_data_rect_extent(*data);
+#else
+			entity->data = *data;
+#endif
+			entity->handle_idx = insertion->handle_idx;
+			entity->update_tick = qt->update_tick;
+			entity->reinsertion_tick = qt->update_tick;
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+			entity->node_entity = 0;
+#endif
+
+			qt->handles[insertion->handle_idx].entity_idx = entity_idx;
+
+#if QUADTREE_LOOSE == 1
+			rect_extent_t exact_extent = quadtree_entity_extent(qt, entity, entity_idx);
+			entity->loose_extent = quadtree_loose_extent(qt, exact_extent, quadtree_loose_leaf_extent(qt, exact_extent));
+#endif
+			rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+			uint32_t in_nodes = 0;
+
+			node_info = node_infos;
+
+			*(node_info++) =
+			(quadtree_node_info_t)
+			{
+				.node_idx = 0,
+				.extent = qt->half_extent
+			};
+
+			do
+			{
+				quadtree_node_info_t info = *(--node_info);
+				quadtree_node_t* node = nodes + info.node_idx;
+
+				if(node->type != QUADTREE_NODE_TYPE_LEAF)
+				{
+#if QUADTREE_BRANCH_ENTITIES == 1
+					if(quadtree_branch_holds(qt, entity_extent, info.extent))
+					{
+						*node_info = info;
+						(node_info++)->node_idx = node->children + 4;
+						continue;
+					}
+#endif
+
+					quadtree_descend(entity_extent);
+					continue;
+				}
+
+				rect_extent_t node_extent = half_to_rect_extent(info.extent);
+				uint32_t node_entity_idx;
+
+				++in_nodes;
+
+				quadtree_mark_dirty(info.node_idx);
+
+				if(free_node_entity)
+				{
+					node_entity_idx = free_node_entity;
+					free_node_entity = node_entities.next[node_entity_idx];
+				}
+				else
+				{
+					if(node_entities_used >= node_entities_size)
+					{
+						uint32_t new_size = (node_entities_used << 1) | 3;
+						assert_neq(new_size, node_entities_size);
+
+						node_entities.next = quadtree_heap_call(alloc_remalloc(node_entities.next, node_entities_size, new_size));
+						assert_not_null(node_entities.next);
+
+						node_entities.entities = quadtree_heap_call(alloc_remalloc(node_entities.entities, node_entities_size, new_size));
+						assert_not_null(node_entities.entities);
+
+						node_entities.flags = quadtree_heap_call(alloc_remalloc(node_entities.flags, node_entities_size, new_size));
+						assert_not_null(node_entities.flags);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+						node_entities.links = quadtree_heap_call(alloc_remalloc(node_entities.links, node_entities_size, new_size));
+						assert_not_null(node_entities.links);
+#endif
+
+						node_entities_size = new_size;
+					}
+
+					node_entity_idx = node_entities_used++;
+				}
+
+				node_entities.next[node_entity_idx] = node->head;
+				node_entities.entities[node_entity_idx].is_last = !node->head;
+				node_entities.entities[node_entity_idx].index = entity_idx;
+				quadtree_set_node_entity_extent(node_entities.entities + node_entity_idx,
+					quadtree_entity_extent(qt, entity, entity_idx), node_extent);
+				node->head = node_entity_idx;
+
+				quadtree_reset_flags();
+
+				++node->count;
+			}
+			while(node_info != node_infos);
+
+			assert_neq(in_nodes, 0);
+			entity->in_nodes_minus_one = in_nodes - 1;
+
+			++insertion;
+		}
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+		qt->insertions_used = 0;
+#else
+		alloc_free(insertions, qt->insertions_size);
+		qt->insertions = NULL;
+		qt->insertions_used = 0;
+		qt->insertions_size = 0;
+#endif
+	}
+
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	if(qt->node_entities_holes <= node_entities_used >> 2)
+	{
+		qt->node_entities = node_entities;
+		qt->node_entities_used = node_entities_used;
+		qt->node_entities_size = node_entities_size;
+
+		qt->entities = entities;
+		qt->entities_used = entities_used;
+		qt->entities_size = entities_size;
+
+		qt->free_entity = free_entity;
+
+		quadtree_normalize_dirty(qt, node_entities_base, free_node_entity);
+		return;
+	}
+
+	qt->dirty_nodes_used = 0;
+	qt->free_node = 0;
+	qt->free_entity = 0;
+	qt->node_entities_holes = 0;
+#endif
+
+	{
+		uint32_t free_node = 0;
+		uint32_t nodes_used = qt->nodes_used;
+		uint32_t nodes_size = qt->nodes_size;
+
+		quadtree_node_t* new_nodes;
+		quadtree_node_entities_t new_node_entities;
+		quadtree_entity_t* new_entities;
+#if QUADTREE_ENTITY_SOA == 1
+		rect_extent_t* new_entity_extents;
+#endif
+
+		uint32_t new_nodes_used = 1;
+		uint32_t new_nodes_size;
+
+		uint32_t new_node_entities_used = 1;
+		uint32_t new_node_entities_size;
+
+		uint32_t new_entities_used = 1;
+		uint32_t new_entities_size;
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+		/* Rebuilt into the spare arrays, which are only reallocated to catch up with the tree */
+		if(qt->spare_nodes_size < nodes_size)
+		{
+			alloc_free(qt->spare_nodes, qt->spare_nodes_size);
+			qt->spare_nodes = quadtree_heap_call(alloc_malloc(qt->spare_nodes, nodes_size));
+			assert_ptr(qt->spare_nodes, nodes_size);
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+			alloc_free(qt->spare_node_parents, qt->spare_nodes_size);
+			qt->spare_node_parents = quadtree_heap_call(alloc_malloc(qt->spare_node_parents, nodes_size));
+			assert_ptr(qt->spare_node_parents, nodes_size);
+#endif
+
+			qt->spare_nodes_size = nodes_size;
+		}
+
+		if(qt->spare_node_entities_size < node_entities_size)
+		{
+			quadtree_node_entities_t* spare = &qt->spare_node_entities;
+			uint32_t spare_size = qt->spare_node_entities_size;
+
+			alloc_free(spare->next, spare_size);
+			spare->next = quadtree_heap_call(alloc_malloc(spare->next, node_entities_size));
+			assert_ptr(spare->next, node_entities_size);
+
+			alloc_free(spare->entities, spare_size);
+			spare->entities = quadtree_heap_call(alloc_malloc(spare->entities, node_entities_size));
+			assert_ptr(spare->entities, node_entities_size);
+
+			alloc_free(spare->flags, spare_size);
+			spare->flags = quadtree_heap_call(alloc_malloc(spare->flags, node_entities_size));
+			assert_ptr(spare->flags, node_entities_size);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+			alloc_free(spare->links, spare_size);
+			spare->links = quadtree_heap_call(alloc_malloc(spare->links, node_entities_size));
+			assert_ptr(spare->links, node_entities_size);
+#endif
+
+			qt->spare_node_entities_size = node_entities_size;
+		}
+
+		if(qt->spare_entities_size < entities_size)
+		{
+			alloc_free(qt->spare_entities, qt->spare_entities_size);
+			qt->spare_entities = quadtree_heap_call(alloc_malloc(qt->spare_entities, entities_size));
+			assert_ptr(qt->spare_entities, entities_size);
+
+#if QUADTREE_ENTITY_SOA == 1
+			alloc_free(qt->spare_entity_extents, qt->spare_entities_size);
+			qt->spare_entity_extents = quadtree_heap_call(alloc_malloc(qt->spare_entity_extents, entities_size));
+			assert_ptr(qt->spare_entity_extents, entities_size);
+#endif
+
+			qt->spare_entities_size = entities_size;
+		}
+
+		if(qt->entity_map_size < entities_size)
+		{
+			alloc_free(qt->entity_map, qt->entity_map_size);
+			qt->entity_map = quadtree_heap_call(alloc_malloc(qt->entity_map, entities_size));
+			assert_ptr(qt->entity_map, entities_size);
+
+			qt->entity_map_size = entities_size;
+		}
+
+		new_nodes = qt->spare_nodes;
+		new_nodes_size = qt->spare_nodes_size;
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		uint32_t* new_node_parents = qt->spare_node_parents;
+#endif
+
+		new_node_entities = qt->spare_node_entities;
+		new_node_entities_size = qt->spare_node_entities_size;
+
+		new_entities = qt->spare_entities;
+		new_entities_size = qt->spare_entities_size;
+#if QUADTREE_ENTITY_SOA == 1
+		new_entity_extents = qt->spare_entity_extents;
+#endif
+
+		uint32_t* entity_map = qt->entity_map;
+		memset(entity_map, 0, sizeof(*entity_map) * entities_used);
+#else
+		if(nodes_size >> 2 < nodes_used)
+		{
+			new_nodes_size = nodes_size;
+		}
+		else
+		{
+			new_nodes_size = nodes_size >> 1;
+		}
+
+
+		if(node_entities_size >> 2 < node_entities_used)
+		{
+			new_node_entities_size = node_entities_size;
+		}
+		else
+		{
+			new_node_entities_size = node_entities_size >> 1;
+		}
+
+
+		if(entities_size >> 2 < entities_used)
+		{
+			new_entities_size = entities_size;
+		}
+		else
+		{
+			new_entities_size = entities_size >> 1;
+		}
+
+		new_nodes = quadtree_heap_call(alloc_malloc(new_nodes, new_nodes_size));
+		assert_ptr(new_nodes, new_nodes_size);
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		uint32_t* new_node_parents = quadtree_heap_call(alloc_malloc(new_node_parents, new_nodes_size));
+		assert_ptr(new_node_parents, new_nodes_size);
+#endif
+
+		new_node_entities.next = quadtree_heap_call(alloc_malloc(new_node_entities.next, new_node_entities_size));
+		assert_ptr(new_node_entities.next, new_node_entities_size);
+
+		new_node_entities.entities = quadtree_heap_call(alloc_malloc(new_node_entities.entities, new_node_entities_size));
+		assert_ptr(new_node_entities.entities, new_node_entities_size);
+
+		new_node_entities.flags = quadtree_heap_call(alloc_malloc(new_node_entities.flags, new_node_entities_size));
+		assert_ptr(new_node_entities.flags, new_node_entities_size);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+		new_node_entities.links = quadtree_heap_call(alloc_malloc(new_node_entities.links, new_node_entities_size));
+		assert_ptr(new_node_entities.links, new_node_entities_size);
+#endif
+
+		new_entities = quadtree_heap_call(alloc_malloc(new_entities, new_entities_size));
+		assert_ptr(new_entities, new_entities_size);
+
+#if QUADTREE_ENTITY_SOA == 1
+		new_entity_extents = quadtree_heap_call(alloc_malloc(new_entity_extents, new_entities_size));
+		assert_ptr(new_entity_extents, new_entities_size);
+#endif
+
+		uint32_t* entity_map = quadtree_heap_call(alloc_calloc(entity_map, entities_size));
+		assert_ptr(entity_map, entities_size);
+#endif
+
+
+		typedef struct quadtree_node_reorder_info
+		{
+			uint32_t node_idx;
+			half_extent_t extent;
+			rect_extent_t bounds;
+			uint32_t new_node_idx;
+			uint32_t parent_node_idx;
+			uint32_t depth;
+#if QUADTREE_BRANCH_ENTITIES == 1
+			bool spill;
+#endif
+#if QUADTREE_HILBERT_ORDER == 1
+			uint8_t curve;
+#endif
+		}
+		quadtree_node_reorder_info_t;
+
+		quadtree_node_reorder_info_t node_infos[qt->dfs_length];
+		quadtree_node_reorder_info_t* node_info = node_infos;
+
+		/* Summed as the leaves are copied, the branches then once the tree is in place */
+		bool node_sums_valid = qt->node_sums_valid;
+		qt->stale_nodes_used = 0;
+
+		if(node_sums_valid)
+		{
+			quadtree_node_sums_reserve(qt, new_nodes_size);
+		}
+
+		*(node_info++) =
+		(quadtree_node_reorder_info_t)
+		{
+			.node_idx = 0,
+			.extent = qt->half_extent,
+			.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY },
+			.new_node_idx = 0,
+			.parent_node_idx = 0,
+			.depth = 1
+		};
+
+		do
+		{
+			quadtree_node_reorder_info_t info = *(--node_info);
+			quadtree_node_t* node = nodes + info.node_idx;
+
+			uint32_t new_node_idx = info.new_node_idx;
+			quadtree_node_t* new_node = new_nodes + new_node_idx;
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+			new_node_parents[new_node_idx] = info.parent_node_idx;
+#endif
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+			bool spill = info.spill;
+#else
+			bool spill = false;
+#endif
+
+			if(node->type != QUADTREE_NODE_TYPE_LEAF)
+			{
+				uint32_t total = 0;
+				bool possible = true;
+
+				for(uint32_t i = 0; i < 4; ++i)
+				{
+					quadtree_node_t* child = nodes + node->children + i;
+
+					if(child->type != QUADTREE_NODE_TYPE_LEAF)
+					{
+						possible = false;
+						break;
+					}
+
+					total += child->count;
+				}
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+				total += nodes[node->children + 4].count;
+#endif
+
+				if(possible && total <= qt->merge_threshold)
+				{
+					uint32_t children_idx = node->children;
+
+					quadtree_node_t* children[QUADTREE_NODE_BLOCK];
+					for(uint32_t i = 0; i < QUADTREE_NODE_BLOCK; ++i)
+					{
+						children[i] = nodes + children_idx + i;
+					}
+
+					node->head = 0;
+					node->position_flags = 0;
+					node->count = 0;
+					node->type = QUADTREE_NODE_TYPE_LEAF;
+
+					rect_extent_t node_extent = half_to_rect_extent(info.extent);
+
+					uint32_t merge_indexes[qt->merge_threshold];
+					uint32_t merge_count = 0;
+
+					for(uint32_t i = 0; i < QUADTREE_NODE_BLOCK; ++i)
+					{
+						quadtree_node_t* child = children[i];
+
+						node->position_flags |= child->position_flags;
+
+						uint32_t node_entity_idx = child->head;
+						while(node_entity_idx)
+						{
+							uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
+							quadtree_entity_t* entity = entities + entity_idx;
+
+							uint32_t next_node_entity_idx = node_entities.next[node_entity_idx];
+							bool is_duplicate = false;
+
+							if(entity->in_nodes_minus_one)
+							{
+								for(uint32_t j = 0; j < merge_count; ++j)
+								{
+									if(merge_indexes[j] == entity_idx)
+									{
+										is_duplicate = true;
+										break;
+									}
+								}
+							}
+
+							if(!is_duplicate)
+							{
+								merge_indexes[merge_count++] = entity_idx;
+
+								node_entities.next[node_entity_idx] = node->head;
+								node_entities.entities[node_entity_idx].is_last = !node->head;
+								node->head = node_entity_idx;
+
+#if QUADTREE_NODE_ENTITY_EXTENT == 2
+								quadtree_set_node_entity_extent(node_entities.entities + node_entity_idx,
+									quadtree_entity_extent(qt, entity, entity_idx), node_extent);
+#endif
+								rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+								quadtree_reset_flags();
+
+								++node->count;
+							}
+							else
+							{
+								node_entities.next[node_entity_idx] = free_node_entity;
+								free_node_entity = node_entity_idx;
+
+								--entity->in_nodes_minus_one;
+								if(entity_map[entity_idx])
+								{
+									new_entities[entity_map[entity_idx]].in_nodes_minus_one = entity->in_nodes_minus_one;
+								}
+							}
+
+							node_entity_idx = next_node_entity_idx;
+						}
+					}
+
+					children[0]->next = free_node;
+					free_node = children_idx;
+
+					qt->normalization |= QUADTREE_NOT_NORMALIZED_SOFT;
+				}
+			}
+			else if(
+				!spill &&
+				node->count >= qt->split_threshold &&
+				info.extent.w >= qt->min_size &&
+				info.extent.h >= qt->min_size &&
+				info.depth < qt->max_depth
+				)
+			{
+				uint32_t children_idx;
+
+				if(free_node)
+				{
+					children_idx = free_node;
+					free_node = nodes[children_idx].next;
+				}
+				else
+				{
+					if(nodes_used + QUADTREE_NODE_BLOCK > nodes_size)
+					{
+						uint32_t new_size = ((nodes_used + QUADTREE_NODE_BLOCK) << 1) | 3;
+
+						nodes = quadtree_heap_call(alloc_remalloc(nodes, nodes_size, new_size));
+						assert_not_null(nodes);
+
+						nodes_size = new_size;
+
+						node = nodes + info.node_idx;
+					}
+
+					children_idx = nodes_used;
+					nodes_used += QUADTREE_NODE_BLOCK;
+				}
+
+				quadtree_node_t* children[QUADTREE_NODE_BLOCK];
+				uint32_t head = node->head;
+				uint32_t position_flags = node->position_flags;
+
+				node->children = children_idx;
+				node->type = QUADTREE_NODE_TYPE_BRANCH;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+				children[4] = nodes + children_idx + 4;
+
+				children[4]->head = 0;
+				children[4]->count = 0;
+				children[4]->type = QUADTREE_NODE_TYPE_LEAF;
+				children[4]->position_flags = position_flags;
+#endif
+
+				for(uint32_t i = 0; i < 4; ++i)
+				{
+					quadtree_node_t* child = nodes + children_idx + i;
+					children[i] = child;
+
+					child->head = 0;
+					child->count = 0;
+					child->type = QUADTREE_NODE_TYPE_LEAF;
+
+					static const uint32_t position_flags_mask[4] =
+					{
+						0b0011,
+						0b1001,
+						0b0110,
+						0b1100
+					};
+
+					child->position_flags = position_flags & position_flags_mask[i];
+				}
+
+				uint32_t node_entity_idx = head;
+				while(node_entity_idx)
+				{
+					uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
+					quadtree_entity_t* entity = entities + entity_idx;
+
+#if QUADTREE_LOOSE == 1
+					/* The entity may have left its loose extent without entering any new node */
+					quadtree_loose_widen(qt, entity, entity_idx);
+#endif
+					rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+
+					uint32_t target_node_idxs[4];
+					uint32_t* current_target_node_idx = target_node_idxs;
+
+					if(entity_extent.min_x <= info.extent.x)
+					{
+						if(entity_extent.min_y <= info.extent.y)
+						{
+							*(current_target_node_idx++) = 0;
+						}
+						if(entity_extent.max_y >= info.extent.y)
+						{
+							*(current_target_node_idx++) = 1;
+						}
+					}
+					if(entity_extent.max_x >= info.extent.x)
+					{
+						if(entity_extent.min_y <= info.extent.y)
+						{
+							*(current_target_node_idx++) = 2;
+						}
+						if(entity_extent.max_y >= info.extent.y)
+						{
+							*(current_target_node_idx++) = 3;
+						}
+					}
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+					if(quadtree_branch_holds(qt, entity_extent, info.extent))
+					{
+						current_target_node_idx = target_node_idxs;
+						*(current_target_node_idx++) = 4;
+					}
+#endif
+
+					entity->in_nodes_minus_one += current_target_node_idx - target_node_idxs - 1;
+					if(entity_map[entity_idx])
+					{
+						new_entities[entity_map[entity_idx]].in_nodes_minus_one = entity->in_nodes_minus_one;
+#if QUADTREE_LOOSE == 1
+						new_entities[entity_map[entity_idx]].loose_extent = entity->loose_extent;
+#endif
+					}
+
+					for(uint32_t* target_node_idx = target_node_idxs; target_node_idx != current_target_node_idx; ++target_node_idx)
+					{
+						quadtree_node_t* target_node = children[*target_node_idx];
+
+						uint32_t new_node_entity_idx;
+
+						if(free_node_entity)
+						{
+							new_node_entity_idx = free_node_entity;
+							free_node_entity = node_entities.next[new_node_entity_idx];
+						}
+						else
+						{
+							if(node_entities_used >= node_entities_size)
+							{
+								uint32_t new_size = (node_entities_used << 1) | 3;
+								assert_neq(new_size, node_entities_size);
+
+								node_entities.next = quadtree_heap_call(alloc_remalloc(node_entities.next, node_entities_size, new_size));
+								assert_not_null(node_entities.next);
+
+								node_entities.entities = quadtree_heap_call(alloc_remalloc(node_entities.entities, node_entities_size, new_size));
+								assert_not_null(node_entities.entities);
+
+								node_entities.flags = quadtree_heap_call(alloc_remalloc(node_entities.flags, node_entities_size, new_size));
+								assert_not_null(node_entities.flags);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+								node_entities.links = quadtree_heap_call(alloc_remalloc(node_entities.links, node_entities_size, new_size));
+								assert_not_null(node_entities.links);
+#endif
+
+								node_entities_size = new_size;
+
+								if(new_size > new_node_entities_size)
+								{
+									new_node_entities.next = quadtree_heap_call(alloc_remalloc(new_node_entities.next, new_node_entities_size, new_size));
+									assert_not_null(new_node_entities.next);
+
+									new_node_entities.entities = quadtree_heap_call(alloc_remalloc(new_node_entities.entities, new_node_entities_size, new_size));
+									assert_not_null(new_node_entities.entities);
+
+									new_node_entities.flags = quadtree_heap_call(alloc_remalloc(new_node_entities.flags, new_node_entities_size, new_size));
+									assert_not_null(new_node_entities.flags);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+									new_node_entities.links = quadtree_heap_call(alloc_remalloc(new_node_entities.links, new_node_entities_size, new_size));
+									assert_not_null(new_node_entities.links);
+#endif
+
+									new_node_entities_size = new_size;
+								}
+							}
+
+							new_node_entity_idx = node_entities_used++;
+						}
+
+						node_entities.next[new_node_entity_idx] = target_node->head;
+						node_entities.entities[new_node_entity_idx].is_last = !target_node->head;
+						node_entities.entities[new_node_entity_idx].index = entity_idx;
+						quadtree_set_node_entity_extent(node_entities.entities + new_node_entity_idx,
+							quadtree_entity_extent(qt, entity, entity_idx), quadtree_child_rect_extent(info.extent, *target_node_idx));
+						node_entities.flags[new_node_entity_idx] = node_entities.flags[node_entity_idx];
+						target_node->head = new_node_entity_idx;
+
+						++target_node->count;
+					}
+
+					uint32_t next_node_entity_idx = node_entities.next[node_entity_idx];
+
+					node_entities.next[node_entity_idx] = free_node_entity;
+					free_node_entity = node_entity_idx;
+
+					node_entity_idx = next_node_entity_idx;
+				}
+			}
+
+			if(node->type != QUADTREE_NODE_TYPE_LEAF)
+			{
+				if(new_nodes_used + QUADTREE_NODE_BLOCK > new_nodes_size)
+				{
+					uint32_t new_size = ((new_nodes_used + QUADTREE_NODE_BLOCK) << 1) | 3;
+
+					new_nodes = quadtree_heap_call(alloc_remalloc(new_nodes, new_nodes_size, new_size));
+					assert_not_null(new_nodes);
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+					new_node_parents = quadtree_heap_call(alloc_remalloc(new_node_parents, new_nodes_size, new_size));
+					assert_not_null(new_node_parents);
+#endif
+
+					new_nodes_size = new_size;
+
+					new_node = new_nodes + new_node_idx;
+
+					if(node_sums_valid)
+					{
+						quadtree_node_sums_reserve(qt, new_nodes_size);
+					}
+				}
+
+				uint32_t new_children_idx = new_nodes_used;
+				new_nodes_used += QUADTREE_NODE_BLOCK;
+
+				new_node->children = new_children_idx;
+				new_node->type = QUADTREE_NODE_TYPE_BRANCH;
+
+				float half_w = info.extent.w * 0.5f;
+				float half_h = info.extent.h * 0.5f;
+				uint32_t next_depth = info.depth + 1;
+
+#if QUADTREE_HILBERT_ORDER == 1
+				quadtree_node_reorder_info_t* child_infos = node_info;
+#endif
+
+				*(node_info++) =
+				(quadtree_node_reorder_info_t)
+				{
+					.node_idx = node->children + 0,
+					.extent =
+					(half_extent_t)
+					{
+						.x = info.extent.x - half_w,
+						.y = info.extent.y - half_h,
+						.w = half_w,
+						.h = half_h
+					},
+					.new_node_idx = new_children_idx + 0,
+					.parent_node_idx = new_node_idx,
+					.depth = next_depth
+				};
+
+				*(node_info++) =
+				(quadtree_node_reorder_info_t)
+				{
+					.node_idx = node->children + 1,
+					.extent =
+					(half_extent_t)
+					{
+						.x = info.extent.x - half_w,
+						.y = info.extent.y + half_h,
+						.w = half_w,
+						.h = half_h
+					},
+					.new_node_idx = new_children_idx + 1,
+					.parent_node_idx = new_node_idx,
+					.depth = next_depth
+				};
+
+				*(node_info++) =
+				(quadtree_node_reorder_info_t)
+				{
+					.node_idx = node->children + 2,
+					.extent =
+					(half_extent_t)
+					{
+						.x = info.extent.x + half_w,
+						.y = info.extent.y - half_h,
+						.w = half_w,
+						.h = half_h
+					},
+					.new_node_idx = new_children_idx + 2,
+					.parent_node_idx = new_node_idx,
+					.depth = next_depth
+				};
+
+				*(node_info++) =
+				(quadtree_node_reorder_info_t)
+				{
+					.node_idx = node->children + 3,
+					.extent =
+					(half_extent_t)
+					{
+						.x = info.extent.x + half_w,
+						.y = info.extent.y + half_h,
+						.w = half_w,
+						.h = half_h
+					},
+					.new_node_idx = new_children_idx + 3,
+					.parent_node_idx = new_node_idx,
+					.depth = next_depth
+				};
+
+				for(quadtree_node_reorder_info_t* child_info = node_info - 4; child_info != node_info; ++child_info)
+				{
+					child_info->bounds = quadtree_query_child_bounds(info.bounds, info.extent, child_info->extent);
+				}
+
+#if QUADTREE_HILBERT_ORDER == 1
+				/* Children in the order this curve passes through them, and the curve each one takes */
+				static const uint8_t hilbert_children[4][4] =
+				{
+					{ 0, 1, 3, 2 },
+					{ 0, 2, 3, 1 },
+					{ 3, 1, 0, 2 },
+					{ 3, 2, 0, 1 }
+				};
+
+				static const uint8_t hilbert_curves[4][4] =
+				{
+					{ 1, 0, 0, 2 },
+					{ 0, 1, 1, 3 },
+					{ 3, 2, 2, 0 },
+					{ 2, 3, 3, 1 }
+				};
+
+				quadtree_node_reorder_info_t quadrants[4];
+				memcpy(quadrants, child_infos, sizeof(quadrants));
+
+				for(uint32_t i = 0; i < 4; ++i)
+				{
+					quadtree_node_reorder_info_t* child_info = child_infos + 3 - i;
+
+					*child_info = quadrants[hilbert_children[info.curve][i]];
+					child_info->curve = hilbert_curves[info.curve][i];
+				}
+#endif
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+				*(node_info++) =
+				(quadtree_node_reorder_info_t)
+				{
+					.node_idx = node->children + 4,
+					.extent = info.extent,
+					.bounds = info.bounds,
+					.new_node_idx = new_children_idx + 4,
+					.parent_node_idx = new_node_idx,
+					.depth = next_depth,
+					.spill = true
+				};
+#endif
+			}
+			else
+			{
+				new_node->position_flags = node->position_flags & 0b1111; /* TRBL */
+				new_node->type = QUADTREE_NODE_TYPE_LEAF;
+
+				if(node_sums_valid)
+				{
+					quadtree_node_sums_reset(qt, new_node_idx);
+				}
+
+				if(!node->head)
+				{
+					new_node->head = 0;
+					new_node->count = 0;
+
+					continue;
+				}
+
+				uint32_t node_entity_idx = node->head;
+
+				new_node->head = new_node_entities_used;
+				new_node->count = node->count;
+
+				while(1)
+				{
+					uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
+					if(!entity_map[entity_idx])
+					{
+						uint32_t new_entity_idx = new_entities_used++;
+						entity_map[entity_idx] = new_entity_idx;
+						new_entities[new_entity_idx] = entities[entity_idx];
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+						new_entities[new_entity_idx].node_entity = 0;
+#endif
+#if QUADTREE_ENTITY_SOA == 1
+						new_entity_extents[new_entity_idx] = qt->entity_extents[entity_idx];
+#endif
+						qt->handles[entities[entity_idx].handle_idx].entity_idx = new_entity_idx;
+					}
+
+					if(node_sums_valid)
+					{
+						quadtree_node_sums_add(qt, new_node_idx, info.bounds, entities + entity_idx, entity_idx);
+					}
+
+					uint32_t new_entity_idx = entity_map[entity_idx];
+					new_node_entities.entities[new_node_entities_used].index = new_entity_idx;
+					quadtree_copy_node_entity_extent(new_node_entities.entities + new_node_entities_used,
+						node_entities.entities + node_entity_idx);
+					new_node_entities.flags[new_node_entities_used] = node_entities.flags[node_entity_idx];
+
+					if(node_entities.next[node_entity_idx])
+					{
+						node_entity_idx = node_entities.next[node_entity_idx];
+						new_node_entities.entities[new_node_entities_used].is_last = false;
+						new_node_entities.next[new_node_entities_used] = new_node_entities_used + 1;
+						++new_node_entities_used;
+					}
+					else
+					{
+						new_node_entities.entities[new_node_entities_used].is_last = true;
+						new_node_entities.next[new_node_entities_used] = 0;
+						++new_node_entities_used;
+						break;
+					}
+				}
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+				quadtree_link_node_entities(new_entities, new_node_entities,
+					new_node_idx, new_node->head, new_node->count);
+#endif
+			}
+		}
+		while(node_info != node_infos);
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+		/* The old arrays are what the next rebuild goes into */
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		uint32_t* node_parents = qt->node_parents;
+
+		if(qt->nodes_size != nodes_size)
+		{
+			node_parents = quadtree_heap_call(alloc_remalloc(node_parents, qt->nodes_size, nodes_size));
+			assert_not_null(node_parents);
+		}
+
+		qt->spare_node_parents = node_parents;
+		qt->node_parents = new_node_parents;
+#endif
+
+		qt->spare_nodes = nodes;
+		qt->spare_nodes_size = nodes_size;
+
+		qt->spare_node_entities = node_entities;
+		qt->spare_node_entities_size = node_entities_size;
+
+		qt->spare_entities = entities;
+		qt->spare_entities_size = entities_size;
+
+#if QUADTREE_ENTITY_SOA == 1
+		qt->spare_entity_extents = qt->entity_extents;
+		qt->entity_extents = new_entity_extents;
+#endif
+
+		qt->nodes = new_nodes;
+		qt->nodes_used = new_nodes_used;
+		qt->nodes_size = new_nodes_size;
+
+		qt->node_entities = new_node_entities;
+		qt->node_entities_used = new_node_entities_used;
+		qt->node_entities_size = new_node_entities_size;
+
+		qt->entities = new_entities;
+		qt->entities_used = new_entities_used;
+		qt->entities_size = new_entities_size;
+#else
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		alloc_free(qt->node_parents, qt->nodes_size);
+		qt->node_parents = new_node_parents;
+#endif
+
+		alloc_free(nodes, nodes_size);
+		qt->nodes = new_nodes;
+		qt->nodes_used = new_nodes_used;
+		qt->nodes_size = new_nodes_size;
+
+		alloc_free(node_entities.next, node_entities_size);
+		alloc_free(node_entities.entities, node_entities_size);
+		alloc_free(node_entities.flags, node_entities_size);
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+		alloc_free(node_entities.links, node_entities_size);
+#endif
+		qt->node_entities = new_node_entities;
+		qt->node_entities_used = new_node_entities_used;
+		qt->node_entities_size = new_node_entities_size;
+
+		alloc_free(entities, entities_size);
+		qt->entities = new_entities;
+		qt->entities_used = new_entities_used;
+		qt->entities_size = new_entities_size;
+
+#if QUADTREE_ENTITY_SOA == 1
+		alloc_free(qt->entity_extents, entities_size);
+		qt->entity_extents = new_entity_extents;
+#endif
+
+		alloc_free(entity_map, entities_size);
+#endif
+
+		if(node_sums_valid)
+		{
+			quadtree_node_sums_combine_all(qt);
+		}
+	}
+}
+
+
+void
+quadtree_normalize_hard(
+	quadtree_t* qt
+	)
+{
+	assert_not_null(qt);
+
+	if(qt->normalization <= QUADTREE_NOT_NORMALIZED_SOFT)
+	{
+		return;
+	}
+
+	quadtree_normalize(qt);
+}
+
+
+typedef struct quadtree_bulk_item
+{
+	uint32_t key;
+	uint32_t data_idx;
+	rect_extent_t extent;
+}
+quadtree_bulk_item_t;
+
+
+int
+quadtree_bulk_item_cmp(
+	const void* a,
+	const void* b
+	)
+{
+	const quadtree_bulk_item_t* item_a = a;
+	const quadtree_bulk_item_t* item_b = b;
+
+	return (item_a->key < item_b->key) - (item_a->key > item_b->key);
+}
+
+
+uint32_t
+quadtree_morton_spread(
+	uint32_t x
+	)
+{
+	x &= 0xFFFF;
+	x = (x | (x << 8)) & 0x00FF00FF;
+	x = (x | (x << 4)) & 0x0F0F0F0F;
+	x = (x | (x << 2)) & 0x33333333;
+	x = (x | (x << 1)) & 0x55555555;
+
+	return x;
+}
+
+
+uint32_t
+quadtree_morton_key(
+	float x,
+	float y
+	)
+{
+	x = MACRO_MIN(MACRO_MAX(x, 0.0f), 65535.0f);
+	y = MACRO_MIN(MACRO_MAX(y, 0.0f), 65535.0f);
+
+	return (quadtree_morton_spread(x) << 1) | quadtree_morton_spread(y);
+}
+
+
+void
+quadtree_bulk_load(
+	quadtree_t* qt,
+	const quadtree_entity_data* data,
+	uint32_t count,
+	quadtree_handle_t* handles
+	)
+{
+	assert_not_null(qt);
+	assert_eq(qt->entities_used, 1);
+	assert_eq(qt->insertions_used, 0);
+
+	if(!count)
+	{
+		return;
+	}
+
+	assert_not_null(data);
+
+
+	quadtree_bulk_item_t* items = quadtree_heap_call(alloc_malloc(items, count));
+	assert_ptr(items, count);
+
+	{
+		rect_extent_t extent = half_to_rect_extent(qt->half_extent);
+		float scale_x = 65535.0f / (extent.max_x - extent.min_x);
+		float scale_y = 65535.0f / (extent.max_y - extent.min_y);
+
+#if QUADTREE_LOOSE == 1
+		/* The leaves aren't known yet, so only the smallest leaf bounds the margin */
+		half_extent_t leaf_extent = qt->half_extent;
+#endif
+
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			rect_extent_t entity_extent = quadtree_get_entity_data_rect_extent(data[i]);
+#if QUADTREE_LOOSE == 1
+			entity_extent = quadtree_loose_extent(qt, entity_extent, leaf_extent);
+#endif
+
+			float x = ((entity_extent.min_x + entity_extent.max_x) * 0.5f - extent.min_x) * scale_x;
+			float y = ((entity_extent.min_y + entity_extent.max_y) * 0.5f - extent.min_y) * scale_y;
+
+			items[i].key = quadtree_morton_key(x, y);
+			items[i].data_idx = i;
+			items[i].extent = entity_extent;
+		}
+	}
+
+	qsort(items, count, sizeof(*items), quadtree_bulk_item_cmp);
+
+	uint32_t lists_used = count;
+	uint32_t lists_size = count << 1;
+
+	uint32_t* lists = quadtree_heap_call(alloc_malloc(lists, lists_size));
+	assert_ptr(lists, lists_size);
+
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		lists[i] = i;
+	}
+
+
+	uint32_t nodes_used = 1;
+	uint32_t nodes_size = (count / qt->split_threshold) * 2 + 1;
+
+	quadtree_node_t* nodes = quadtree_heap_call(alloc_malloc(nodes, nodes_size));
+	assert_ptr(nodes, nodes_size);
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	uint32_t* node_parents = quadtree_heap_call(alloc_malloc(node_parents, nodes_size));
+	assert_ptr(node_parents, nodes_size);
+#endif
+
+	uint32_t node_entities_used = 1;
+	uint32_t node_entities_size = count + (count >> 1) + 1;
+
+	quadtree_node_entities_t node_entities;
+
+	node_entities.next = quadtree_heap_call(alloc_malloc(node_entities.next, node_entities_size));
+	assert_ptr(node_entities.next, node_entities_size);
+
+	node_entities.entities = quadtree_heap_call(alloc_malloc(node_entities.entities, node_entities_size));
+	assert_ptr(node_entities.entities, node_entities_size);
+
+	node_entities.flags = quadtree_heap_call(alloc_malloc(node_entities.flags, node_entities_size));
+	assert_ptr(node_entities.flags, node_entities_size);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	node_entities.links = quadtree_heap_call(alloc_malloc(node_entities.links, node_entities_size));
+	assert_ptr(node_entities.links, node_entities_size);
+#endif
+
+	uint32_t entities_used = 1;
+	uint32_t entities_size = count + 1;
+
+	quadtree_entity_t* entities = quadtree_heap_call(alloc_malloc(entities, entities_size));
+	assert_ptr(entities, entities_size);
+
+#if QUADTREE_ENTITY_SOA == 1
+	alloc_free(qt->entity_extents, qt->entities_size);
+
+	qt->entity_extents = quadtree_heap_call(alloc_malloc(qt->entity_extents, entities_size));
+	assert_ptr(qt->entity_extents, entities_size);
+#endif
+
+	uint32_t* entity_map = quadtree_heap_call(alloc_calloc(entity_map, count));
+	assert_ptr(entity_map, count);
+
+
+	typedef struct quadtree_bulk_info
+	{
+		half_extent_t extent;
+		rect_extent_t bounds;
+		uint32_t node_idx;
+		uint32_t parent_node_idx;
+		uint32_t depth;
+		uint32_t position_flags;
+		uint32_t list_idx;
+		uint32_t list_end;
+#if QUADTREE_BRANCH_ENTITIES == 1
+		bool spill;
+#endif
+	}
+	quadtree_bulk_info_t;
+
+	/* Summed as the leaves are filled, the branches then once the tree is in place */
+	bool node_sums_valid = qt->node_sums_valid;
+
+	if(node_sums_valid)
+	{
+		quadtree_node_sums_reserve(qt, nodes_size);
+	}
+
+	quadtree_bulk_info_t node_infos[qt->dfs_length];
+	quadtree_bulk_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_bulk_info_t)
+	{
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY },
+		.node_idx = 0,
+		.parent_node_idx = 0,
+		.depth = 1,
+		.position_flags = 0b1111, /* TRBL */
+		.list_idx = 0,
+		.list_end = count
+	};
+
+	do
+	{
+		quadtree_bulk_info_t info = *(--node_info);
+		lists_used = info.list_end;
+
+		uint32_t node_idx = info.node_idx;
+		quadtree_node_t* node = nodes + node_idx;
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		node_parents[node_idx] = info.parent_node_idx;
+#endif
+
+		uint32_t list_count = info.list_end - info.list_idx;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+		bool spill = info.spill;
+#else
+		bool spill = false;
+#endif
+
+		if(
+			!spill &&
+			list_count >= qt->split_threshold &&
+			info.extent.w >= qt->min_size &&
+			info.extent.h >= qt->min_size &&
+			info.depth < qt->max_depth
+			)
+		{
+			uint32_t child_counts[QUADTREE_NODE_BLOCK] = {0};
+
+			for(uint32_t i = info.list_idx; i != info.list_end; ++i)
+			{
+				rect_extent_t entity_extent = items[lists[i]].extent;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+				if(quadtree_branch_holds(qt, entity_extent, info.extent))
+				{
+					++child_counts[4];
+					continue;
+				}
+#endif
+
+				if(entity_extent.min_x <= info.extent.x)
+				{
+					child_counts[0] += entity_extent.min_y <= info.extent.y;
+					child_counts[1] += entity_extent.max_y >= info.extent.y;
+				}
+				if(entity_extent.max_x >= info.extent.x)
+				{
+					child_counts[2] += entity_extent.min_y <= info.extent.y;
+					child_counts[3] += entity_extent.max_y >= info.extent.y;
+				}
+			}
+
+			uint32_t child_idxs[QUADTREE_NODE_BLOCK];
+			uint32_t total = 0;
+
+			for(uint32_t i = 0; i < QUADTREE_NODE_BLOCK; ++i)
+			{
+				child_idxs[i] = lists_used + total;
+				total += child_counts[i];
+			}
+
+			if(lists_used + total > lists_size)
+			{
+				uint32_t new_size = ((lists_used + total) << 1) | 3;
+
+				lists = quadtree_heap_call(alloc_remalloc(lists, lists_size, new_size));
+				assert_not_null(lists);
+
+				lists_size = new_size;
+			}
+
+			uint32_t child_ends[QUADTREE_NODE_BLOCK];
+			memcpy(child_ends, child_idxs, sizeof(child_ends));
+
+			for(uint32_t i = info.list_idx; i != info.list_end; ++i)
+			{
+				uint32_t item_idx = lists[i];
+				rect_extent_t entity_extent = items[item_idx].extent;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+				if(quadtree_branch_holds(qt, entity_extent, info.extent))
+				{
+					lists[child_ends[4]++] = item_idx;
+					continue;
+				}
+#endif
+
+				if(entity_extent.min_x <= info.extent.x)
+				{
+					if(entity_extent.min_y <= info.extent.y)
+					{
+						lists[child_ends[0]++] = item_idx;
+					}
+					if(entity_extent.max_y >= info.extent.y)
+					{
+						lists[child_ends[1]++] = item_idx;
+					}
+				}
+				if(entity_extent.max_x >= info.extent.x)
+				{
+					if(entity_extent.min_y <= info.extent.y)
+					{
+						lists[child_ends[2]++] = item_idx;
+					}
+					if(entity_extent.max_y >= info.extent.y)
+					{
+						lists[child_ends[3]++] = item_idx;
+					}
+				}
+			}
+
+			if(nodes_used + QUADTREE_NODE_BLOCK > nodes_size)
+			{
+				uint32_t new_size = ((nodes_used + QUADTREE_NODE_BLOCK) << 1) | 3;
+
+				nodes = quadtree_heap_call(alloc_remalloc(nodes, nodes_size, new_size));
+				assert_not_null(nodes);
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+				node_parents = quadtree_heap_call(alloc_remalloc(node_parents, nodes_size, new_size));
+				assert_not_null(node_parents);
+#endif
+
+				nodes_size = new_size;
+
+				node = nodes + node_idx;
+
+				if(node_sums_valid)
+				{
+					quadtree_node_sums_reserve(qt, nodes_size);
+				}
+			}
+
+			uint32_t children_idx = nodes_used;
+			nodes_used += QUADTREE_NODE_BLOCK;
+
+			node->children = children_idx;
+			node->type = QUADTREE_NODE_TYPE_BRANCH;
+
+			float half_w = info.extent.w * 0.5f;
+			float half_h = info.extent.h * 0.5f;
+
+			static const uint32_t position_flags_mask[4] =
+			{
+				0b0011,
+				0b1001,
+				0b0110,
+				0b1100
+			};
+
+			for(uint32_t i = 0; i < 4; ++i)
+			{
+				half_extent_t child_extent =
+				{
+					.x = info.extent.x + (i & 2 ? half_w : -half_w),
+					.y = info.extent.y + (i & 1 ? half_h : -half_h),
+					.w = half_w,
+					.h = half_h
+				};
+
+				*(node_info++) =
+				(quadtree_bulk_info_t)
+				{
+					.extent = child_extent,
+					.bounds = quadtree_query_child_bounds(info.bounds, info.extent, child_extent),
+					.node_idx = children_idx + i,
+					.parent_node_idx = node_idx,
+					.depth = info.depth + 1,
+					.position_flags = info.position_flags & position_flags_mask[i],
+					.list_idx = child_idxs[i],
+					.list_end = child_ends[i]
+				};
+			}
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+			*(node_info++) =
+			(quadtree_bulk_info_t)
+			{
+				.extent = info.extent,
+				.bounds = info.bounds,
+				.node_idx = children_idx + 4,
+				.parent_node_idx = node_idx,
+				.depth = info.depth + 1,
+				.position_flags = info.position_flags,
+				.list_idx = child_idxs[4],
+				.list_end = child_ends[4],
+				.spill = true
+			};
+#endif
+
+			continue;
+		}
+
+		node->position_flags = info.position_flags;
+		node->count = list_count;
+		node->type = QUADTREE_NODE_TYPE_LEAF;
+
+		if(node_sums_valid)
+		{
+			quadtree_node_sums_reset(qt, node_idx);
+		}
+
+		if(!list_count)
+		{
+			node->head = 0;
+			continue;
+		}
+
+		if(node_entities_used + list_count > node_entities_size)
+		{
+			uint32_t new_size = ((node_entities_used + list_count) << 1) | 3;
+
+			node_entities.next = quadtree_heap_call(alloc_remalloc(node_entities.next, node_entities_size, new_size));
+			assert_not_null(node_entities.next);
+
+			node_entities.entities = quadtree_heap_call(alloc_remalloc(node_entities.entities, node_entities_size, new_size));
+			assert_not_null(node_entities.entities);
+
+			node_entities.flags = quadtree_heap_call(alloc_remalloc(node_entities.flags, node_entities_size, new_size));
+			assert_not_null(node_entities.flags);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+			node_entities.links = quadtree_heap_call(alloc_remalloc(node_entities.links, node_entities_size, new_size));
+			assert_not_null(node_entities.links);
+#endif
+
+			node_entities_size = new_size;
+		}
+
+		node->head = node_entities_used;
+
+		rect_extent_t node_extent = half_to_rect_extent(info.extent);
+
+		for(uint32_t i = info.list_idx; i != info.list_end; ++i)
+		{
+			uint32_t item_idx = lists[i];
+			uint32_t entity_idx = entity_map[item_idx];
+			quadtree_entity_t* entity;
+
+			if(!entity_idx)
+			{
+				entity_idx = entities_used++;
+				entity_map[item_idx] = entity_idx;
+
+				entity = entities + entity_idx;
+
+				uint32_t data_idx = items[item_idx].data_idx;
+				uint32_t handle_idx = quadtree_handle_alloc(qt);
+				quadtree_handle_slot_t* handle = qt->handles + handle_idx;
+
+				handle->entity_idx = entity_idx;
+
+				if(handles)
+				{
+					handles[data_idx] = (handle->generation << QUADTREE_HANDLE_INDEX_BITS) | handle_idx;
+				}
+
+#if QUADTREE_ENTITY_SOA == 1
+				qt->entity_data[handle_idx] = data[data_idx];
+				qt->entity_extents[entity_idx] = quadtree_get_entity_data_rect_extent(data[data_idx]);
+#else
+				entity->data = data[data_idx];
+#endif
+				entity->handle_idx = handle_idx;
+#if QUADTREE_LOOSE == 1
+				entity->loose_extent = items[item_idx].extent;
+#endif
+				entity->in_nodes_minus_one = 0;
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+				entity->node_entity = 0;
+#endif
+				entity->update_tick = qt->update_tick;
+				entity->reinsertion_tick = qt->update_tick;
+			}
+			else
+			{
+				entity = entities + entity_idx;
+				++entity->in_nodes_minus_one;
+			}
+
+			if(node_sums_valid)
+			{
+				quadtree_node_sums_add(qt, node_idx, info.bounds, entity, entity_idx);
+			}
+
+			rect_extent_t entity_extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+			uint32_t node_entity_idx = node_entities_used++;
+			bool is_last = i + 1 == info.list_end;
+
+			node_entities.next[node_entity_idx] = is_last ? 0 : node_entity_idx + 1;
+			node_entities.entities[node_entity_idx].is_last = is_last;
+			node_entities.entities[node_entity_idx].index = entity_idx;
+			quadtree_set_node_entity_extent(node_entities.entities + node_entity_idx,
+				quadtree_entity_extent(qt, entity, entity_idx), node_extent);
+
+			quadtree_reset_flags();
+		}
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+		quadtree_link_node_entities(entities, node_entities, node_idx, node->head, list_count);
+#endif
+	}
+	while(node_info != node_infos);
+
+	assert_eq(entities_used, count + 1);
+
+	alloc_free(entity_map, count);
+	alloc_free(lists, lists_size);
+	alloc_free(items, count);
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	alloc_free(qt->node_parents, qt->nodes_size);
+	qt->node_parents = node_parents;
+#endif
+
+	alloc_free(qt->nodes, qt->nodes_size);
+	qt->nodes = nodes;
+	qt->nodes_used = nodes_used;
+	qt->nodes_size = nodes_size;
+
+	alloc_free(qt->node_entities.next, qt->node_entities_size);
+	alloc_free(qt->node_entities.entities, qt->node_entities_size);
+	alloc_free(qt->node_entities.flags, qt->node_entities_size);
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	alloc_free(qt->node_entities.links, qt->node_entities_size);
+#endif
+	qt->node_entities = node_entities;
+	qt->node_entities_used = node_entities_used;
+	qt->node_entities_size = node_entities_size;
+
+	alloc_free(qt->entities, qt->entities_size);
+	qt->entities = entities;
+	qt->entities_used = entities_used;
+	qt->entities_size = entities_size;
+
+	if(node_sums_valid)
+	{
+		quadtree_node_sums_combine_all(qt);
+	}
+}
+
+
+void
+quadtree_update(
+	quadtree_t* qt,
+	quadtree_update_fn_t update_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(update_fn);
+
+	quadtree_normalize_hard(qt);
+
+	qt->update_tick ^= 1;
+	uint32_t update_tick = qt->update_tick;
+
+	quadtree_node_t* nodes = qt->nodes;
+#if QUADTREE_INCREMENTAL_NORMALIZE == 0 && QUADTREE_HILBERT_ORDER == 0
+	uint32_t* node_entities_next = qt->node_entities.next;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+	uint8_t* node_entities_flags = qt->node_entities.flags;
+#if QUADTREE_LOOSE == 0
+	uint8_t* node_entities_flags_copy = node_entities_flags;
+#endif
+#else
+	uint8_t* node_entities_flags_copy = qt->node_entities.flags;
+#endif
+	quadtree_entity_t* entities = qt->entities;
+	quadtree_reinsertion_t* reinsertions = qt->reinsertions;
+	quadtree_node_removal_t* node_removals = qt->node_removals;
+
+	uint32_t reinsertions_used = qt->reinsertions_used;
+	uint32_t reinsertions_size = qt->reinsertions_size;
+
+	uint32_t node_removals_used = qt->node_removals_used;
+	uint32_t node_removals_size = qt->node_removals_size;
+
+	quadtree_node_info_t node_infos[qt->dfs_length];
+	quadtree_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_node_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent
+	};
+
+	do
+	{
+		quadtree_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend_all();
+			quadtree_descend_spill();
+			continue;
+		}
+
+		if(!node->head)
+		{
+			continue;
+		}
+
+		rect_extent_t node_extent = half_to_rect_extent(info.extent);
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 0 && QUADTREE_HILBERT_ORDER == 0
+		/* Leaves are laid out in the order this walk reaches them */
+		assert_eq(node_entities + 1, qt->node_entities.entities + node->head);
+#else
+		uint32_t* node_entities_next = qt->node_entities.next + node->head - 1;
+		quadtree_node_entity_t* node_entities = qt->node_entities.entities + node->head - 1;
+		uint8_t* node_entities_flags = node_entities_flags_copy + node->head - 1;
+#endif
+
+		do
+		{
+			++node_entities_next;
+			++node_entities;
+			++node_entities_flags;
+
+			uint32_t entity_idx = node_entities->index;
+			quadtree_entity_t* entity = entities + entity_idx;
+
+			if(entity->update_tick != update_tick)
+			{
+				entity->update_tick = update_tick;
+				entity->reinsertion_tick = update_tick ^ 1;
+
+				quadtree_entity_info_t entity_info =
+				{
+					.idx = entity_idx,
+					.data = quadtree_entity_payload(qt, entity)
+				};
+				entity->status = update_fn(qt, entity_info, user_data);
+				quadtree_sync_entity_extent(qt, entity, entity_idx);
+			}
+
+			if(entity->status == QUADTREE_STATUS_NOT_CHANGED)
+			{
+				continue;
+			}
+
+			quadtree_stale_push(qt, info.node_idx, info.extent.x, info.extent.y);
+
+			rect_extent_t extent = quadtree_entity_extent(qt, entity, entity_idx);
+			quadtree_set_node_entity_extent(node_entities, extent, node_extent);
+
+#if QUADTREE_LOOSE == 1
+			if(!quadtree_loose_escaped(entity, extent))
+			{
+				continue;
+			}
+#endif
+
+			uint8_t old_flags = *node_entities_flags;
+			uint8_t pos_flags = node->position_flags;
+
+			uint8_t new_flags =
+				((-(uint8_t)(extent.max_y >= node_extent.max_y)) & 0b1000 & ~pos_flags) |
+				((-(uint8_t)(extent.max_x >= node_extent.max_x)) & 0b0100 & ~pos_flags) |
+				((-(uint8_t)(extent.min_y <= node_extent.min_y)) & 0b0010 & ~pos_flags) |
+				((-(uint8_t)(extent.min_x <= node_extent.min_x)) & 0b0001 & ~pos_flags);
+
+#if QUADTREE_LOOSE == 0
+			*node_entities_flags = new_flags;
+#endif
+			bool crossed_new_boundary = new_flags & ~old_flags;
+
+#if QUADTREE_LOOSE == 0
+			bool left_node =
+				(extent.max_x < node_extent.min_x && !(node->position_flags & 0b0001)) ||
+				(extent.max_y < node_extent.min_y && !(node->position_flags & 0b0010)) ||
+				(node_extent.max_x < extent.min_x && !(node->position_flags & 0b0100)) ||
+				(node_extent.max_y < extent.min_y && !(node->position_flags & 0b1000));
+#endif
+
+			if(crossed_new_boundary && entity->reinsertion_tick != update_tick)
+			{
+				entity->reinsertion_tick = update_tick;
+
+				uint32_t reinsertion_idx;
+				quadtree_reinsertion_t* reinsertion;
+
+				if(reinsertions_used >= reinsertions_size)
+				{
+					uint32_t new_size = (reinsertions_used << 1) | 3;
+					assert_neq(new_size, reinsertions_size);
+
+					reinsertions = quadtree_heap_call(alloc_remalloc(reinsertions, reinsertions_size, new_size));
+					assert_not_null(reinsertions);
+
+					reinsertions_size = new_size;
+				}
+
+				reinsertion_idx = reinsertions_used++;
+				reinsertion = reinsertions + reinsertion_idx;
+
+				reinsertion->entity_idx = entity_idx;
+#if QUADTREE_LOOSE == 0
+				reinsertion->node_idx = left_node ? 0 : info.node_idx;
+#else
+				reinsertion->node_idx = 0;
+#endif
+
+				qt->normalization |= QUADTREE_NOT_NORMALIZED_HARD;
+			}
+
+#if QUADTREE_LOOSE == 0
+			if(left_node)
+			{
+				uint32_t node_removal_idx;
+				quadtree_node_removal_t* node_removal;
+
+				if(node_removals_used >= node_removals_size)
+				{
+					uint32_t new_size = (node_removals_used << 1) | 3;
+					assert_neq(new_size, node_removals_size);
+
+					node_removals = quadtree_heap_call(alloc_remalloc(node_removals, node_removals_size, new_size));
+					assert_not_null(node_removals);
+
+					node_removals_size = new_size;
+				}
+
+				node_removal_idx = node_removals_used++;
+				node_removal = node_removals + node_removal_idx;
+
+				uint32_t idx = node_entities_flags - node_entities_flags_copy;
+
+				node_removal->node_idx = info.node_idx;
+				node_removal->node_entity_idx = idx;
+				node_removal->entity_idx = entity_idx;
+
+				qt->normalization |= QUADTREE_NOT_NORMALIZED_HARD;
+			}
+#endif
+		}
+		while(*node_entities_next);
+	}
+	while(node_info != node_infos);
+
+	qt->reinsertions = reinsertions;
+	qt->reinsertions_used = reinsertions_used;
+	qt->reinsertions_size = reinsertions_size;
+
+	qt->node_removals = node_removals;
+	qt->node_removals_used = node_removals_used;
+	qt->node_removals_size = node_removals_size;
+}
+
+
+quadtree_status_t
+quadtree_update_updated(
+	quadtree_t* qt,
+	quadtree_entity_info_t info,
+	void* user_data
+	)
+{
+	(void) qt;
+	(void) info;
+	(void) user_data;
+
+	/* Never called, every entity was updated before quadtree_update runs */
+	return QUADTREE_STATUS_NOT_CHANGED;
+}
+
+
+void
+quadtree_update_batch(
+	quadtree_t* qt,
+	quadtree_update_batch_fn_t update_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(update_fn);
+
+	quadtree_normalize_hard(qt);
+
+	uint8_t update_tick = qt->update_tick ^ 1;
+	quadtree_entity_t* entities = qt->entities;
+
+	uint32_t idxs[QUADTREE_UPDATE_BATCH_SIZE];
+	quadtree_entity_data* data[QUADTREE_UPDATE_BATCH_SIZE];
+
+	uint32_t entity_idx = 1;
+	uint32_t entities_used = qt->entities_used;
+
+	while(entity_idx < entities_used)
+	{
+		uint32_t count = 0;
+
+		while(entity_idx < entities_used && count < QUADTREE_UPDATE_BATCH_SIZE)
+		{
+			quadtree_entity_t* entity = entities + entity_idx;
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+			if(entity->in_nodes_minus_one != QUADTREE_ENTITY_FREE)
+#endif
+			{
+				idxs[count] = entity_idx;
+				data[count] = quadtree_entity_payload(qt, entity);
+				++count;
+			}
+
+			++entity_idx;
+		}
+
+		if(!count)
+		{
+			break;
+		}
+
+		uint64_t changed = update_fn(qt, idxs, data, count, user_data);
+
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			quadtree_entity_t* entity = entities + idxs[i];
+
+			entity->update_tick = update_tick;
+			entity->reinsertion_tick = update_tick ^ 1;
+			entity->status = (changed >> i) & 1 ? QUADTREE_STATUS_CHANGED : QUADTREE_STATUS_NOT_CHANGED;
+			quadtree_sync_entity_extent(qt, entity, idxs[i]);
+		}
+	}
+
+	quadtree_update(qt, quadtree_update_updated, NULL);
+}
+
+
+/* A spill subtree stands for the entities of the branch at node_idx, not the nodes below it */
+typedef struct quadtree_subtree
+{
+	uint32_t node_idx;
+	half_extent_t extent;
+	rect_extent_t bounds;
+#if QUADTREE_BRANCH_ENTITIES == 1
+	bool spill;
+#endif
+}
+quadtree_subtree_t;
+
+
+#define quadtree_fill_subtree(_node_idx, _extent)								\
+(quadtree_subtree_t)															\
+{																				\
+	.node_idx = _node_idx,														\
+	.extent = _extent,															\
+	.bounds =																	\
+	{																			\
+		.min_x = _extent.x < info.extent.x ? info.bounds.min_x : info.extent.x,	\
+		.min_y = _extent.y < info.extent.y ? info.bounds.min_y : info.extent.y,	\
+		.max_x = _extent.x < info.extent.x ? info.extent.x : info.bounds.max_x,	\
+		.max_y = _extent.y < info.extent.y ? info.extent.y : info.bounds.max_y	\
+	}																			\
+}
+
+
+uint32_t
+quadtree_subtrees(
+	quadtree_t* qt,
+	quadtree_subtree_t* subtrees,
+	uint32_t subtrees_target
+	)
+{
+	quadtree_node_t* nodes = qt->nodes;
+
+	subtrees[0] =
+	(quadtree_subtree_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = half_to_rect_extent(qt->half_extent)
+	};
+
+	uint32_t subtrees_used = 1;
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_subtree(__VA_ARGS__)
+
+	while(subtrees_used < subtrees_target)
+	{
+		quadtree_subtree_t next_subtrees[subtrees_used * QUADTREE_NODE_BLOCK];
+		quadtree_subtree_t* node_info = next_subtrees;
+
+		for(uint32_t i = 0; i < subtrees_used; ++i)
+		{
+			quadtree_subtree_t info = subtrees[i];
+			quadtree_node_t* node = nodes + info.node_idx;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+			if(node->type == QUADTREE_NODE_TYPE_LEAF || info.spill)
+#else
+			if(node->type == QUADTREE_NODE_TYPE_LEAF)
+#endif
+			{
+				*(node_info++) = info;
+				continue;
+			}
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+			/* Ahead of the children, where a depth first walk reaches the branch's entities */
+			if(nodes[node->children + 4].head)
+			{
+				info.spill = true;
+				*(node_info++) = info;
+			}
+#endif
+
+			quadtree_descend_all();
+
+			quadtree_subtree_t temp = node_info[-4];
+			node_info[-4] = node_info[-1];
+			node_info[-1] = temp;
+
+			temp = node_info[-3];
+			node_info[-3] = node_info[-2];
+			node_info[-2] = temp;
+		}
+
+		uint32_t next_subtrees_used = node_info - next_subtrees;
+		if(next_subtrees_used == subtrees_used)
+		{
+			break;
+		}
+
+		memcpy(subtrees, next_subtrees, sizeof(*subtrees) * next_subtrees_used);
+		subtrees_used = next_subtrees_used;
+	}
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
+
+	return subtrees_used;
+}
+
+
+void
+quadtree_thread_check(
+	quadtree_t* qt,
+	quadtree_thread_t* thread,
+	uint32_t node_idx,
+	uint32_t node_entity_idx,
+	rect_extent_t node_extent,
+	uint32_t entity_idx
+	)
+{
+	quadtree_node_t* node = qt->nodes + node_idx;
+	quadtree_entity_t* entity = qt->entities + entity_idx;
+
+	rect_extent_t extent = quadtree_entity_extent(qt, entity, entity_idx);
+	quadtree_set_node_entity_extent(qt->node_entities.entities + node_entity_idx, extent, node_extent);
+
+	if(
+		qt->node_sums_valid &&
+		(!thread->stale_nodes_used || thread->stale_nodes[thread->stale_nodes_used - 1].node_idx != node_idx)
+		)
+	{
+		if(thread->stale_nodes_used >= thread->stale_nodes_size)
+		{
+			uint32_t new_size = (thread->stale_nodes_used << 1) | 3;
+			assert_neq(new_size, thread->stale_nodes_size);
+
+			thread->stale_nodes = quadtree_heap_call(alloc_remalloc(thread->stale_nodes, thread->stale_nodes_size, new_size));
+			assert_not_null(thread->stale_nodes);
+
+			thread->stale_nodes_size = new_size;
+		}
+
+		thread->stale_nodes[thread->stale_nodes_used++] =
+		(quadtree_stale_node_t)
+		{
+			.node_idx = node_idx,
+			.x = (node_extent.min_x + node_extent.max_x) * 0.5f,
+			.y = (node_extent.min_y + node_extent.max_y) * 0.5f
+		};
+	}
+
+#if QUADTREE_LOOSE == 1
+	if(!quadtree_loose_escaped(entity, extent))
+	{
+		return;
+	}
+#endif
+
+	uint8_t old_flags = qt->node_entities.flags[node_entity_idx];
+	uint8_t pos_flags = node->position_flags;
+
+	uint8_t new_flags =
+		((-(uint8_t)(extent.max_y >= node_extent.max_y)) & 0b1000 & ~pos_flags) |
+		((-(uint8_t)(extent.max_x >= node_extent.max_x)) & 0b0100 & ~pos_flags) |
+		((-(uint8_t)(extent.min_y <= node_extent.min_y)) & 0b0010 & ~pos_flags) |
+		((-(uint8_t)(extent.min_x <= node_extent.min_x)) & 0b0001 & ~pos_flags);
+
+#if QUADTREE_LOOSE == 0
+	qt->node_entities.flags[node_entity_idx] = new_flags;
+#endif
+	bool crossed_new_boundary = new_flags & ~old_flags;
+
+#if QUADTREE_LOOSE == 0
+	bool left_node =
+		(extent.max_x < node_extent.min_x && !(node->position_flags & 0b0001)) ||
+		(extent.max_y < node_extent.min_y && !(node->position_flags & 0b0010)) ||
+		(node_extent.max_x < extent.min_x && !(node->position_flags & 0b0100)) ||
+		(node_extent.max_y < extent.min_y && !(node->position_flags & 0b1000));
+#endif
+
+	if(crossed_new_boundary)
+	{
+		if(thread->reinsertions_used >= thread->reinsertions_size)
+		{
+			uint32_t new_size = (thread->reinsertions_used << 1) | 3;
+			assert_neq(new_size, thread->reinsertions_size);
+
+			thread->reinsertions = quadtree_heap_call(alloc_remalloc(thread->reinsertions, thread->reinsertions_size, new_size));
+			assert_not_null(thread->reinsertions);
+
+			thread->reinsertions_size = new_size;
+		}
+
+		uint32_t reinsertion_idx = thread->reinsertions_used++;
+		quadtree_reinsertion_t* reinsertion = thread->reinsertions + reinsertion_idx;
+
+		reinsertion->entity_idx = entity_idx;
+#if QUADTREE_LOOSE == 0
+		reinsertion->node_idx = left_node ? 0 : node_idx;
+#else
+		reinsertion->node_idx = 0;
+#endif
+	}
+
+#if QUADTREE_LOOSE == 0
+	if(left_node)
+	{
+		if(thread->node_removals_used >= thread->node_removals_size)
+		{
+			uint32_t new_size = (thread->node_removals_used << 1) | 3;
+			assert_neq(new_size, thread->node_removals_size);
+
+			thread->node_removals = quadtree_heap_call(alloc_remalloc(thread->node_removals, thread->node_removals_size, new_size));
+			assert_not_null(thread->node_removals);
+
+			thread->node_removals_size = new_size;
+		}
+
+		uint32_t node_removal_idx = thread->node_removals_used++;
+		quadtree_node_removal_t* node_removal = thread->node_removals + node_removal_idx;
+
+		node_removal->node_idx = node_idx;
+		node_removal->node_entity_idx = node_entity_idx;
+		node_removal->entity_idx = entity_idx;
+	}
+#endif
+}
+
+
+typedef struct quadtree_update_task
+{
+	quadtree_t* qt;
+	quadtree_update_fn_t update_fn;
+	void* user_data;
+	quadtree_subtree_t* subtrees;
+	uint32_t subtrees_used;
+	uint8_t update_tick;
+}
+quadtree_update_task_t;
+
+
+void
+quadtree_update_parallel_fn(
+	void* data,
+	uint32_t thread_idx
+	)
+{
+	quadtree_update_task_t* task = data;
+	quadtree_t* qt = task->qt;
+	quadtree_thread_t* thread = qt->threads + thread_idx;
+
+	uint8_t update_tick = task->update_tick;
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_entities_t node_entities = qt->node_entities;
+	quadtree_entity_t* entities = qt->entities;
+
+	thread->reinsertions_used = 0;
+	thread->node_removals_used = 0;
+	thread->update_deferrals_used = 0;
+	thread->stale_nodes_used = 0;
+
+	uint32_t subtree_idx = task->subtrees_used * thread_idx / qt->thread_count;
+	uint32_t subtree_end = task->subtrees_used * (thread_idx + 1) / qt->thread_count;
+
+	quadtree_node_info_t node_infos[qt->dfs_length];
+	quadtree_node_info_t* node_info;
+
+	for(; subtree_idx != subtree_end; ++subtree_idx)
+	{
+		quadtree_subtree_t* subtree = task->subtrees + subtree_idx;
+
+		node_info = node_infos;
+		*(node_info++) =
+		(quadtree_node_info_t)
+		{
+			.node_idx = subtree->node_idx,
+			.extent = subtree->extent
+		};
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+		if(subtree->spill)
+		{
+			node_infos[0].node_idx = nodes[subtree->node_idx].children + 4;
+		}
+#endif
+
+		do
+		{
+			quadtree_node_info_t info = *(--node_info);
+			quadtree_node_t* node = nodes + info.node_idx;
+
+			if(node->type != QUADTREE_NODE_TYPE_LEAF)
+			{
+				quadtree_descend_all();
+				quadtree_descend_spill();
+				continue;
+			}
+
+			if(!node->head)
+			{
+				continue;
+			}
+
+			rect_extent_t node_extent = half_to_rect_extent(info.extent);
+			uint32_t node_entity_idx = node->head - 1;
+
+			do
+			{
+				++node_entity_idx;
+
+				uint32_t entity_idx = node_entities.entities[node_entity_idx].index;
+				quadtree_entity_t* entity = entities + entity_idx;
+
+				quadtree_entity_info_t entity_info =
+				{
+					.idx = entity_idx,
+					.data = quadtree_entity_payload(qt, entity)
+				};
+
+				if(entity->in_nodes_minus_one)
+				{
+					if(__atomic_exchange_n(&entity->update_tick, update_tick, __ATOMIC_RELAXED) != update_tick)
+					{
+						entity->reinsertion_tick = update_tick ^ 1;
+						entity->status = task->update_fn(qt, entity_info, task->user_data);
+						quadtree_sync_entity_extent(qt, entity, entity_idx);
+					}
+
+					if(thread->update_deferrals_used >= thread->update_deferrals_size)
+					{
+						uint32_t new_size = (thread->update_deferrals_used << 1) | 3;
+						assert_neq(new_size, thread->update_deferrals_size);
+
+						thread->update_deferrals = quadtree_heap_call(alloc_remalloc(thread->update_deferrals, thread->update_deferrals_size, new_size));
+						assert_not_null(thread->update_deferrals);
+
+						thread->update_deferrals_size = new_size;
+					}
+
+					uint32_t update_deferral_idx = thread->update_deferrals_used++;
+					quadtree_update_deferral_t* update_deferral = thread->update_deferrals + update_deferral_idx;
+
+					update_deferral->node_idx = info.node_idx;
+					update_deferral->node_entity_idx = node_entity_idx;
+					update_deferral->node_extent = node_extent;
+
+					continue;
+				}
+
+				entity->update_tick = update_tick;
+				entity->status = task->update_fn(qt, entity_info, task->user_data);
+				quadtree_sync_entity_extent(qt, entity, entity_idx);
+
+				if(entity->status == QUADTREE_STATUS_NOT_CHANGED)
+				{
+					continue;
+				}
+
+				quadtree_thread_check(qt, thread, info.node_idx, node_entity_idx, node_extent, entity_idx);
+			}
+			while(node_entities.next[node_entity_idx]);
+		}
+		while(node_info != node_infos);
+	}
+}
+
+
+void
+quadtree_update_parallel_deferred_fn(
+	void* data,
+	uint32_t thread_idx
+	)
+{
+	quadtree_update_task_t* task = data;
+	quadtree_t* qt = task->qt;
+	quadtree_thread_t* thread = qt->threads + thread_idx;
+
+	if(!thread->update_deferrals_used)
+	{
+		return;
+	}
+
+	uint32_t node_removals_used = thread->node_removals_used;
+
+	quadtree_update_deferral_t* update_deferral = thread->update_deferrals;
+	quadtree_update_deferral_t* update_deferral_end = update_deferral + thread->update_deferrals_used;
+
+	for(; update_deferral != update_deferral_end; ++update_deferral)
+	{
+		uint32_t node_entity_idx = update_deferral->node_entity_idx;
+		uint32_t entity_idx = qt->node_entities.entities[node_entity_idx].index;
+
+		if(qt->entities[entity_idx].status == QUADTREE_STATUS_NOT_CHANGED)
+		{
+			continue;
+		}
+
+		quadtree_thread_check(qt, thread, update_deferral->node_idx,
+			node_entity_idx, update_deferral->node_extent, entity_idx);
+	}
+
+	if(node_removals_used != thread->node_removals_used)
+	{
+		qsort(thread->node_removals, thread->node_removals_used,
+			sizeof(*thread->node_removals), quadtree_node_removal_cmp);
+	}
+}
+
+
+void
+quadtree_update_merge(
+	quadtree_t* qt,
+	uint32_t thread_count,
+	uint8_t update_tick
+	)
+{
+	quadtree_entity_t* entities = qt->entities;
+
+	uint32_t reinsertions_used = qt->reinsertions_used;
+	uint32_t node_removals_used = qt->node_removals_used;
+
+	for(uint32_t i = 0; i < thread_count; ++i)
+	{
+		quadtree_thread_t* thread = qt->threads + i;
+
+		/* Threads without work may never have allocated their buffers */
+		if(thread->reinsertions_used)
+		{
+			if(reinsertions_used + thread->reinsertions_used > qt->reinsertions_size)
+			{
+				uint32_t new_size = ((reinsertions_used + thread->reinsertions_used) << 1) | 3;
+
+				qt->reinsertions = quadtree_heap_call(alloc_remalloc(qt->reinsertions, qt->reinsertions_size, new_size));
+				assert_not_null(qt->reinsertions);
+
+				qt->reinsertions_size = new_size;
+			}
+
+			quadtree_reinsertion_t* reinsertion = thread->reinsertions;
+			quadtree_reinsertion_t* reinsertion_end = reinsertion + thread->reinsertions_used;
+
+			for(; reinsertion != reinsertion_end; ++reinsertion)
+			{
+				quadtree_entity_t* entity = entities + reinsertion->entity_idx;
+
+				if(entity->in_nodes_minus_one)
+				{
+					if(entity->reinsertion_tick == update_tick)
+					{
+						continue;
+					}
+
+					entity->reinsertion_tick = update_tick;
+				}
+
+				qt->reinsertions[reinsertions_used++] = *reinsertion;
+			}
+		}
+
+		if(thread->node_removals_used)
+		{
+			if(node_removals_used + thread->node_removals_used > qt->node_removals_size)
+			{
+				uint32_t new_size = ((node_removals_used + thread->node_removals_used) << 1) | 3;
+
+				qt->node_removals = quadtree_heap_call(alloc_remalloc(qt->node_removals, qt->node_removals_size, new_size));
+				assert_not_null(qt->node_removals);
+
+				qt->node_removals_size = new_size;
+			}
+
+			memcpy(qt->node_removals + node_removals_used, thread->node_removals,
+				sizeof(*thread->node_removals) * thread->node_removals_used);
+			node_removals_used += thread->node_removals_used;
+		}
+
+		for(uint32_t j = 0; j < thread->stale_nodes_used; ++j)
+		{
+			quadtree_stale_node_t* stale_node = thread->stale_nodes + j;
+			quadtree_stale_push(qt, stale_node->node_idx, stale_node->x, stale_node->y);
+		}
+	}
+
+	if(
+		reinsertions_used != qt->reinsertions_used ||
+		node_removals_used != qt->node_removals_used
+		)
+	{
+		qt->normalization |= QUADTREE_NOT_NORMALIZED_HARD;
+	}
+
+	qt->reinsertions_used = reinsertions_used;
+	qt->node_removals_used = node_removals_used;
+}
+
+
+void
+quadtree_update_parallel(
+	quadtree_t* qt,
+	quadtree_update_fn_t update_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(update_fn);
+
+	if(qt->thread_count <= 1)
+	{
+		quadtree_update(qt, update_fn, user_data);
+		return;
+	}
+
+	quadtree_normalize_hard(qt);
+
+	qt->update_tick ^= 1;
+	uint8_t update_tick = qt->update_tick;
+
+	uint32_t subtrees_target = qt->thread_count * 16;
+	quadtree_subtree_t subtrees[subtrees_target * QUADTREE_NODE_BLOCK];
+
+	quadtree_update_task_t task =
+	{
+		.qt = qt,
+		.update_fn = update_fn,
+		.user_data = user_data,
+		.subtrees = subtrees,
+		.subtrees_used = quadtree_subtrees(qt, subtrees, subtrees_target),
+		.update_tick = update_tick
+	};
+
+	pool_run(&qt->pool, quadtree_update_parallel_fn, &task);
+	pool_run(&qt->pool, quadtree_update_parallel_deferred_fn, &task);
+
+	quadtree_update_merge(qt, qt->thread_count, update_tick);
+}
+
+
+void
+quadtree_update_linear(
+	quadtree_t* qt,
+	quadtree_update_fn_t update_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(update_fn);
+
+	quadtree_normalize_hard(qt);
+
+	uint8_t update_tick = qt->update_tick ^ 1;
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_entities_t node_entities = qt->node_entities;
+	quadtree_entity_t* entities = qt->entities;
+	quadtree_thread_t* thread = qt->threads;
+
+	uint32_t changes_used = 0;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	uint32_t changes_size = qt->changes_size;
+	quadtree_update_change_t* changes = qt->changes;
+#else
+	uint32_t changes_size = 0;
+	quadtree_update_change_t* changes = NULL;
+#endif
+
+	for(uint32_t entity_idx = 1; entity_idx < qt->entities_used; ++entity_idx)
+	{
+		quadtree_entity_t* entity = entities + entity_idx;
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		if(entity->in_nodes_minus_one == QUADTREE_ENTITY_FREE)
+		{
+			continue;
+		}
+#endif
+
+		/* The nodes an entity is in are found with the extent it had before the update */
+		rect_extent_t extent = quadtree_get_entity_tree_extent(qt, entity, entity_idx);
+
+		entity->update_tick = update_tick;
+		entity->reinsertion_tick = update_tick ^ 1;
+
+		quadtree_entity_info_t entity_info =
+		{
+			.idx = entity_idx,
+			.data = quadtree_entity_payload(qt, entity)
+		};
+		entity->status = update_fn(qt, entity_info, user_data);
+		quadtree_sync_entity_extent(qt, entity, entity_idx);
+
+		if(entity->status == QUADTREE_STATUS_NOT_CHANGED)
+		{
+			continue;
+		}
+
+		if(changes_used >= changes_size)
+		{
+			uint32_t new_size = (changes_used << 1) | 3;
+			assert_neq(new_size, changes_size);
+
+			changes = quadtree_heap_call(alloc_remalloc(changes, changes_size, new_size));
+			assert_not_null(changes);
+
+			changes_size = new_size;
+		}
+
+		changes[changes_used++] =
+		(quadtree_update_change_t)
+		{
+			.entity_idx = entity_idx,
+			.extent = extent
+		};
+	}
+
+	/* Descending once per entity only pays off while few entities changed */
+	if(changes_used > qt->entities_used >> 4)
+	{
+#if QUADTREE_SCRATCH_ARENAS == 1
+		qt->changes = changes;
+		qt->changes_size = changes_size;
+#else
+		alloc_free(changes, changes_size);
+#endif
+
+		quadtree_update(qt, quadtree_update_updated, NULL);
+		return;
+	}
+
+	qt->update_tick = update_tick;
+
+	thread->reinsertions_used = 0;
+	thread->node_removals_used = 0;
+	thread->stale_nodes_used = 0;
+
+	quadtree_node_info_t node_infos[qt->dfs_length];
+	quadtree_node_info_t* node_info;
+
+	quadtree_update_change_t* change = changes;
+	quadtree_update_change_t* change_end = change + changes_used;
+
+	for(; change != change_end; ++change)
+	{
+		uint32_t entity_idx = change->entity_idx;
+
+		node_info = node_infos;
+		*(node_info++) =
+		(quadtree_node_info_t)
+		{
+			.node_idx = 0,
+			.extent = qt->half_extent
+		};
+
+		do
+		{
+			quadtree_node_info_t info = *(--node_info);
+			quadtree_node_t* node = nodes + info.node_idx;
+
+			if(node->type != QUADTREE_NODE_TYPE_LEAF)
+			{
+#if QUADTREE_BRANCH_ENTITIES == 1
+				/* An entity held by a branch is in none of the nodes below it */
+				uint32_t spill_idx = node->children + 4;
+				uint32_t node_entity_idx = nodes[spill_idx].head;
+
+				while(node_entity_idx && node_entities.entities[node_entity_idx].index != entity_idx)
+				{
+					node_entity_idx = node_entities.next[node_entity_idx];
+				}
+
+				if(node_entity_idx)
+				{
+					quadtree_thread_check(qt, thread, spill_idx, node_entity_idx,
+						half_to_rect_extent(info.extent), entity_idx);
+					continue;
+				}
+#endif
+
+				quadtree_descend(change->extent);
+				continue;
+			}
+
+			uint32_t node_entity_idx = node->head;
+
+			while(node_entities.entities[node_entity_idx].index != entity_idx)
+			{
+				node_entity_idx = node_entities.next[node_entity_idx];
+			}
+
+			quadtree_thread_check(qt, thread, info.node_idx, node_entity_idx,
+				half_to_rect_extent(info.extent), entity_idx);
+		}
+		while(node_info != node_infos);
+	}
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+	qt->changes = changes;
+	qt->changes_size = changes_size;
+#else
+	alloc_free(changes, changes_size);
+#endif
+
+	qsort(thread->node_removals, thread->node_removals_used,
+		sizeof(*thread->node_removals), quadtree_node_removal_cmp);
+
+	quadtree_update_merge(qt, 1, update_tick);
+}
+
+
+uint32_t
+quadtree_query_scratch_begin(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch
+	)
+{
+	if(scratch->ticks_size < qt->entities_used)
+	{
+		uint32_t new_size = qt->entities_size;
+
+		scratch->ticks = quadtree_heap_call(alloc_remalloc(scratch->ticks, scratch->ticks_size, new_size));
+		assert_not_null(scratch->ticks);
+
+		memset(scratch->ticks + scratch->ticks_size, 0,
+			sizeof(*scratch->ticks) * (new_size - scratch->ticks_size));
+
+		scratch->ticks_size = new_size;
+	}
+
+	if(!++scratch->tick)
+	{
+		memset(scratch->ticks, 0, sizeof(*scratch->ticks) * scratch->ticks_size);
+		scratch->tick = 1;
+	}
+
+	return scratch->tick;
+}
+
+
+void
+quadtree_query_scratch_free(
+	quadtree_query_scratch_t* scratch
+	)
+{
+	assert_not_null(scratch);
+
+	alloc_free(scratch->masks, scratch->masks_size);
+	scratch->masks = NULL;
+	scratch->masks_size = 0;
+
+	alloc_free(scratch->ticks, scratch->ticks_size);
+	scratch->ticks = NULL;
+	scratch->ticks_size = 0;
+	scratch->tick = 0;
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+	if(scratch->heap.temp)
+	{
+		heap_free(&scratch->heap);
+		scratch->heap.temp = NULL;
+	}
+#endif
+}
+
+
+bool
+quadtree_query_buffer_push(
+	quadtree_query_buffer_t* buffer,
+	uint32_t entity_idx,
+	quadtree_entity_data* data
+	)
+{
+	if(buffer->used >= buffer->idxs_size)
+	{
+		uint32_t new_size = (buffer->used << 1) | 3;
+		assert_neq(new_size, 0);
+
+		buffer->idxs = quadtree_heap_call(alloc_remalloc(buffer->idxs, buffer->idxs_size, new_size));
+		assert_not_null(buffer->idxs);
+
+		buffer->idxs_size = new_size;
+	}
+
+	buffer->idxs[buffer->used] = entity_idx;
+
+	if(buffer->collect_data)
+	{
+		if(buffer->used >= buffer->data_size)
+		{
+			uint32_t new_size = buffer->idxs_size;
+
+			buffer->data = quadtree_heap_call(alloc_remalloc(buffer->data, buffer->data_size, new_size));
+			assert_not_null(buffer->data);
+
+			buffer->data_size = new_size;
+		}
+
+		buffer->data[buffer->used] = data;
+	}
+
+	++buffer->used;
+
+	return buffer->max_results && buffer->used >= buffer->max_results;
+}
+
+
+void
+quadtree_query_buffer_free(
+	quadtree_query_buffer_t* buffer
+	)
+{
+	assert_not_null(buffer);
+
+	alloc_free(buffer->data, buffer->data_size);
+	buffer->data = NULL;
+	buffer->data_size = 0;
+
+	alloc_free(buffer->idxs, buffer->idxs_size);
+	buffer->idxs = NULL;
+	buffer->idxs_size = 0;
+	buffer->used = 0;
+}
+
+
+/* Bounds follow the split lines entities are sorted by, and are unbounded along the root's edges */
+typedef struct quadtree_query_node_info
+{
+	uint32_t node_idx;
+	half_extent_t extent;
+	rect_extent_t bounds;
+}
+quadtree_query_node_info_t;
+
+
+bool
+quadtree_query_rect_covers(
+	rect_extent_t extent,
+	rect_extent_t bounds
+	)
+{
+#if QUADTREE_LOOSE == 1
+	/* Loose entities can stay linked to nodes they no longer reach */
+	(void) extent;
+	(void) bounds;
+
+	return false;
+#else
+	return
+		extent.min_x <= bounds.min_x &&
+		extent.min_y <= bounds.min_y &&
+		extent.max_x >= bounds.max_x &&
+		extent.max_y >= bounds.max_y;
+#endif
+}
+
+
+bool
+quadtree_query_circle_covers(
+	float x,
+	float y,
+	float radius_sq,
+	rect_extent_t bounds
+	)
+{
+#if QUADTREE_LOOSE == 1
+	(void) x;
+	(void) y;
+	(void) radius_sq;
+	(void) bounds;
+
+	return false;
+#else
+	float dx = MACRO_MAX(x - bounds.min_x, bounds.max_x - x);
+	float dy = MACRO_MAX(y - bounds.min_y, bounds.max_y - y);
+
+	return dx * dx + dy * dy <= radius_sq;
+#endif
+}
+
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(_node_idx, _extent)							\
+(quadtree_query_node_info_t)											\
+{																		\
+	.node_idx = _node_idx,												\
+	.extent = _extent,													\
+	.bounds = quadtree_query_child_bounds(info.bounds, info.extent, _extent)	\
+}
+
+
+void
+quadtree_query_rect_run(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	rect_extent_t extent,
+	quadtree_query_fn_t query_fn,
+	void* user_data,
+	quadtree_query_buffer_t* buffer
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(scratch);
+
+	assert_lt(qt->normalization, QUADTREE_NOT_NORMALIZED_HARD);
+
+	uint32_t query_tick = quadtree_query_scratch_begin(qt, scratch);
+	uint32_t* query_ticks = scratch->ticks;
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+	quadtree_entity_t* entities = qt->entities;
+
+	quadtree_query_node_info_t node_infos[qt->dfs_length];
+	quadtree_query_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_query_node_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
+	};
+
+	do
+	{
+		quadtree_query_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend(extent);
+			quadtree_descend_spill();
+			continue;
+		}
+
+		uint32_t idx = node->head;
+		if(!idx)
+		{
+			continue;
+		}
+
+		bool covered = quadtree_query_rect_covers(extent, info.bounds);
+#if QUADTREE_NODE_ENTITY_EXTENT == 2
+		quadtree_quantized_extent_t quantized = quadtree_quantize_extent(extent, half_to_rect_extent(info.extent));
+#endif
+
+		quadtree_node_entity_t* node_entity = node_entities + idx;
+
+		while(1)
+		{
+			uint32_t entity_idx = node_entity->index;
+			quadtree_entity_t* entity = entities + entity_idx;
+
+			if(query_ticks[entity_idx] != query_tick)
+			{
+				query_ticks[entity_idx] = query_tick;
+
+				if(
+					covered ||
+					(
+						quadtree_node_entity_may_intersect(node_entity, quantized) &&
+						rect_extent_intersects(quadtree_node_entity_extent(qt, node_entity), extent)
+					)
+					)
+				{
+					if(buffer)
+					{
+						if(quadtree_query_buffer_push(buffer, entity_idx, quadtree_entity_payload(qt, entity)))
+						{
+							return;
+						}
+					}
+					else
+					{
+						quadtree_entity_info_t entity_info =
+						{
+							.idx = entity_idx,
+							.data = quadtree_entity_payload(qt, entity)
+						};
+
+						quadtree_status_t status = query_fn((quadtree_t*) qt, entity_info, user_data);
+						if(status == QUADTREE_STATUS_CHANGED)
+						{
+							return;
+						}
+					}
+				}
+			}
+
+			if(node_entity->is_last)
+			{
+				break;
+			}
+			++node_entity;
+		}
+	}
+	while(node_info != node_infos);
+}
+
+
+void
+quadtree_query_rect_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	rect_extent_t extent,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(query_fn);
+
+	quadtree_query_rect_run(qt, scratch, extent, query_fn, user_data, NULL);
+}
+
+
+uint32_t
+quadtree_query_rect_collect(
+	quadtree_t* qt,
+	rect_extent_t extent,
+	quadtree_query_buffer_t* buffer
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(buffer);
+
+	quadtree_normalize_hard(qt);
+
+	buffer->used = 0;
+	quadtree_query_rect_run(qt, &qt->query_scratch, extent, NULL, NULL, buffer);
+
+	return buffer->used;
+}
+
+
+void
+quadtree_query_rect(
+	quadtree_t* qt,
+	rect_extent_t extent,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+
+	quadtree_normalize_hard(qt);
+
+	quadtree_query_rect_concurrent(qt, &qt->query_scratch, extent, query_fn, user_data);
+}
+
+
+typedef struct quadtree_query_batch_info
+{
+	uint32_t node_idx;
+	half_extent_t extent;
+	uint64_t mask;
+}
+quadtree_query_batch_info_t;
+
+
+void
+quadtree_query_rects_chunk(
+	quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	const rect_extent_t* extents,
+	uint32_t first,
+	uint32_t count,
+	quadtree_query_batch_fn_t query_fn,
+	void* user_data
+	)
+{
+	uint32_t query_tick = quadtree_query_scratch_begin(qt, scratch);
+	uint32_t* query_ticks = scratch->ticks;
+
+	if(scratch->masks_size < scratch->ticks_size)
+	{
+		uint32_t new_size = scratch->ticks_size;
+
+		scratch->masks = quadtree_heap_call(alloc_remalloc(scratch->masks, scratch->masks_size, new_size));
+		assert_not_null(scratch->masks);
+
+		scratch->masks_size = new_size;
+	}
+
+	/* Only valid for entities whose tick matches, the tick guards them instead of a clear */
+	uint64_t* query_masks = scratch->masks;
+
+	extents += first;
+	uint64_t active = count == 64 ? UINT64_MAX : (UINT64_C(1) << count) - 1;
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+	quadtree_entity_t* entities = qt->entities;
+
+	quadtree_query_batch_info_t node_infos[qt->dfs_length];
+	quadtree_query_batch_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_query_batch_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.mask = active
+	};
+
+	do
+	{
+		quadtree_query_batch_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		uint64_t mask = info.mask & active;
+		if(!mask)
+		{
+			continue;
+		}
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			uint64_t left = 0;
+			uint64_t right = 0;
+			uint64_t bottom = 0;
+			uint64_t top = 0;
+
+			for(uint64_t bits = mask; bits; bits &= bits - 1)
+			{
+				uint32_t i = __builtin_ctzll(bits);
+				rect_extent_t extent = extents[i];
+
+				left |= (uint64_t)(extent.min_x <= info.extent.x) << i;
+				right |= (uint64_t)(extent.max_x >= info.extent.x) << i;
+				bottom |= (uint64_t)(extent.min_y <= info.extent.y) << i;
+				top |= (uint64_t)(extent.max_y >= info.extent.y) << i;
+			}
+
+			float half_w = info.extent.w * 0.5f;
+			float half_h = info.extent.h * 0.5f;
+
+			uint64_t child_masks[4] =
+			{
+				left & bottom,
+				left & top,
+				right & bottom,
+				right & top
+			};
+
+			for(uint32_t i = 0; i < 4; ++i)
+			{
+				if(!child_masks[i])
+				{
+					continue;
+				}
+
+				*(node_info++) =
+				(quadtree_query_batch_info_t)
+				{
+					.node_idx = node->children + i,
+					.extent =
+					(half_extent_t)
+					{
+						.x = info.extent.x + (i & 2 ? half_w : -half_w),
+						.y = info.extent.y + (i & 1 ? half_h : -half_h),
+						.w = half_w,
+						.h = half_h
+					},
+					.mask = child_masks[i]
+				};
+			}
+
+			quadtree_descend_spill();
+			continue;
+		}
+
+		uint32_t idx = node->head;
+		if(!idx)
+		{
+			continue;
+		}
+
+		quadtree_node_entity_t* node_entity = node_entities + idx;
+
+		while(1)
+		{
+			uint32_t entity_idx = node_entity->index;
+			quadtree_entity_t* entity = entities + entity_idx;
+
+			rect_extent_t entity_extent = quadtree_node_entity_extent(qt, node_entity);
+			uint64_t hits = 0;
+
+			for(uint64_t bits = mask; bits; bits &= bits - 1)
+			{
+				uint32_t i = __builtin_ctzll(bits);
+				hits |= (uint64_t) rect_extent_intersects(entity_extent, extents[i]) << i;
+			}
+
+			if(hits)
+			{
+				if(query_ticks[entity_idx] != query_tick)
+				{
+					query_ticks[entity_idx] = query_tick;
+					query_masks[entity_idx] = 0;
+				}
+
+				hits &= ~query_masks[entity_idx];
+				query_masks[entity_idx] |= hits;
+
+				quadtree_entity_info_t entity_info =
+				{
+					.idx = entity_idx,
+					.data = quadtree_entity_payload(qt, entity)
+				};
+
+				for(; hits; hits &= hits - 1)
+				{
+					uint32_t i = __builtin_ctzll(hits);
+
+					quadtree_status_t status = query_fn(qt, first + i, entity_info, user_data);
+					if(status == QUADTREE_STATUS_CHANGED)
+					{
+						active &= ~(UINT64_C(1) << i);
+						mask &= active;
+					}
+				}
+
+				if(!mask)
+				{
+					break;
+				}
+			}
+
+			if(node_entity->is_last)
+			{
+				break;
+			}
+			++node_entity;
+		}
+	}
+	while(node_info != node_infos);
+}
+
+
+void
+quadtree_query_rects(
+	quadtree_t* qt,
+	const rect_extent_t* extents,
+	uint32_t count,
+	quadtree_query_batch_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_ptr(extents, count);
+	assert_not_null(query_fn);
+
+	quadtree_normalize_hard(qt);
+
+	for(uint32_t first = 0; first < count; first += QUADTREE_QUERY_BATCH_SIZE)
+	{
+		quadtree_query_rects_chunk(qt, &qt->query_scratch, extents, first,
+			MACRO_MIN(count - first, QUADTREE_QUERY_BATCH_SIZE), query_fn, user_data);
+	}
+}
+
+
+typedef struct quadtree_query_rects_task
+{
+	quadtree_t* qt;
+	const rect_extent_t* extents;
+	uint32_t count;
+	quadtree_query_batch_fn_t query_fn;
+	void* user_data;
+}
+quadtree_query_rects_task_t;
+
+
+void
+quadtree_query_rects_parallel_fn(
+	void* data,
+	uint32_t thread_idx
+	)
+{
+	quadtree_query_rects_task_t* task = data;
+	quadtree_t* qt = task->qt;
+	quadtree_thread_t* thread = qt->threads + thread_idx;
+
+	uint32_t stride = QUADTREE_QUERY_BATCH_SIZE * qt->thread_count;
+
+	for(
+		uint32_t first = QUADTREE_QUERY_BATCH_SIZE * thread_idx;
+		first < task->count;
+		first += stride
+		)
+	{
+		quadtree_query_rects_chunk(qt, &thread->query_scratch, task->extents, first,
+			MACRO_MIN(task->count - first, QUADTREE_QUERY_BATCH_SIZE), task->query_fn, task->user_data);
+	}
+}
+
+
+void
+quadtree_query_rects_parallel(
+	quadtree_t* qt,
+	const rect_extent_t* extents,
+	uint32_t count,
+	quadtree_query_batch_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_ptr(extents, count);
+	assert_not_null(query_fn);
+
+	if(qt->thread_count <= 1 || count <= QUADTREE_QUERY_BATCH_SIZE)
+	{
+		quadtree_query_rects(qt, extents, count, query_fn, user_data);
+		return;
+	}
+
+	quadtree_normalize_hard(qt);
+
+	quadtree_query_rects_task_t task =
+	{
+		.qt = qt,
+		.extents = extents,
+		.count = count,
+		.query_fn = query_fn,
+		.user_data = user_data
+	};
+
+	pool_run(&qt->pool, quadtree_query_rects_parallel_fn, &task);
+}
+
+
+float
+quadtree_point_to_extent_distance_sq(
+	float x,
+	float y,
+	rect_extent_t extent
+	)
+{
+	float dx = MACRO_MAX(MACRO_MAX(extent.min_x - x, 0.0f), x - extent.max_x);
+	float dy = MACRO_MAX(MACRO_MAX(extent.min_y - y, 0.0f), y - extent.max_y);
+	return dx * dx + dy * dy;
+}
+
+
+void
+quadtree_query_circle_run(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	float x,
+	float y,
+	float radius,
+	quadtree_query_fn_t query_fn,
+	void* user_data,
+	quadtree_query_buffer_t* buffer
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(scratch);
+
+	assert_lt(qt->normalization, QUADTREE_NOT_NORMALIZED_HARD);
+
+	uint32_t query_tick = quadtree_query_scratch_begin(qt, scratch);
+	uint32_t* query_ticks = scratch->ticks;
+
+	float radius_sq = radius * radius;
+
+	rect_extent_t search_extent =
+	{
+		.min_x = x - radius,
+		.min_y = y - radius,
+		.max_x = x + radius,
+		.max_y = y + radius
+	};
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+	quadtree_entity_t* entities = qt->entities;
+
+	quadtree_query_node_info_t node_infos[qt->dfs_length];
+	quadtree_query_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_query_node_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
+	};
+
+	do
+	{
+		quadtree_query_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		rect_extent_t node_extent = half_to_rect_extent(info.extent);
+
+		if(quadtree_point_to_extent_distance_sq(x, y, node_extent) > radius_sq)
+		{
+			continue;
+		}
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend(search_extent);
+			quadtree_descend_spill();
+			continue;
+		}
+
+		uint32_t idx = node->head;
+		if(!idx)
+		{
+			continue;
+		}
+
+		bool covered = quadtree_query_circle_covers(x, y, radius_sq, info.bounds);
+#if QUADTREE_NODE_ENTITY_EXTENT == 2
+		quadtree_quantized_extent_t quantized = quadtree_quantize_extent(search_extent, node_extent);
+#endif
+
+		quadtree_node_entity_t* node_entity = node_entities + idx;
+
+		while(1)
+		{
+			uint32_t entity_idx = node_entity->index;
+			quadtree_entity_t* entity = entities + entity_idx;
+
+			if(query_ticks[entity_idx] != query_tick)
+			{
+				query_ticks[entity_idx] = query_tick;
+
+				if(
+					covered ||
+					(
+						quadtree_node_entity_may_intersect(node_entity, quantized) &&
+						quadtree_point_to_extent_distance_sq(x, y, quadtree_node_entity_extent(qt, node_entity)) <= radius_sq
+					)
+					)
+				{
+					if(buffer)
+					{
+						if(quadtree_query_buffer_push(buffer, entity_idx, quadtree_entity_payload(qt, entity)))
+						{
+							return;
+						}
+					}
+					else
+					{
+						quadtree_entity_info_t entity_info =
+						{
+							.idx = entity_idx,
+							.data = quadtree_entity_payload(qt, entity)
+						};
+
+						quadtree_status_t status = query_fn((quadtree_t*) qt, entity_info, user_data);
+						if(status == QUADTREE_STATUS_CHANGED)
+						{
+							return;
+						}
+					}
+				}
+			}
+
+			if(node_entity->is_last)
+			{
+				break;
+			}
+			++node_entity;
+		}
+	}
+	while(node_info != node_infos);
+}
+
+
+void
+quadtree_query_circle_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	float x,
+	float y,
+	float radius,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(query_fn);
+
+	quadtree_query_circle_run(qt, scratch, x, y, radius, query_fn, user_data, NULL);
+}
+
+
+uint32_t
+quadtree_query_circle_collect(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float radius,
+	quadtree_query_buffer_t* buffer
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(buffer);
+
+	quadtree_normalize_hard(qt);
+
+	buffer->used = 0;
+	quadtree_query_circle_run(qt, &qt->query_scratch, x, y, radius, NULL, NULL, buffer);
+
+	return buffer->used;
+}
+
+
+void
+quadtree_query_circle(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float radius,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+
+	quadtree_normalize_hard(qt);
+
+	quadtree_query_circle_concurrent(qt, &qt->query_scratch, x, y, radius, query_fn, user_data);
+}
+
+
+void
+quadtree_query_nodes_rect(
+	quadtree_t* qt,
+	rect_extent_t extent,
+	quadtree_node_query_fn_t node_query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(node_query_fn);
+
+	quadtree_normalize_hard(qt);
+
+	quadtree_node_t* nodes = qt->nodes;
+
+	quadtree_query_node_info_t node_infos[qt->dfs_length];
+	quadtree_query_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_query_node_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
+	};
+
+	do
+	{
+		quadtree_query_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend(extent);
+			quadtree_descend_spill();
+			continue;
+		}
+
+		quadtree_node_info_t leaf_info =
+		{
+			.node_idx = info.node_idx,
+			.extent = info.extent
+		};
+
+		quadtree_status_t status = node_query_fn(qt, &leaf_info, quadtree_query_rect_covers(extent, info.bounds), user_data);
+		if(status == QUADTREE_STATUS_CHANGED)
+		{
+			return;
+		}
+	}
+	while(node_info != node_infos);
+}
+
+
+void
+quadtree_query_nodes_circle(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float radius,
+	quadtree_node_query_fn_t node_query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(node_query_fn);
+
+	quadtree_normalize_hard(qt);
+
+	float radius_sq = radius * radius;
+
+	rect_extent_t search_extent =
+	{
+		.min_x = x - radius,
+		.min_y = y - radius,
+		.max_x = x + radius,
+		.max_y = y + radius
+	};
+
+	quadtree_node_t* nodes = qt->nodes;
+
+	quadtree_query_node_info_t node_infos[qt->dfs_length];
+	quadtree_query_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_query_node_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
+	};
+
+	do
+	{
+		quadtree_query_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		rect_extent_t node_extent = half_to_rect_extent(info.extent);
+
+		if(quadtree_point_to_extent_distance_sq(x, y, node_extent) > radius_sq)
+		{
+			continue;
+		}
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend(search_extent);
+			quadtree_descend_spill();
+			continue;
+		}
+
+		quadtree_node_info_t leaf_info =
+		{
+			.node_idx = info.node_idx,
+			.extent = info.extent
+		};
+
+		quadtree_status_t status = node_query_fn(qt, &leaf_info, quadtree_query_circle_covers(x, y, radius_sq, info.bounds), user_data);
+		if(status == QUADTREE_STATUS_CHANGED)
+		{
+			return;
+		}
+	}
+	while(node_info != node_infos);
+}
+
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
+
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(_node_idx, _extent)							\
+(quadtree_count_node_info_t)											\
+{																		\
+	.node_idx = _node_idx,												\
+	.extent = _extent,													\
+	.bounds = quadtree_query_child_bounds(info.bounds, info.extent, _extent)	\
+}
+
+
+uint32_t
+quadtree_count_rect(
+	quadtree_t* qt,
+	rect_extent_t extent
+	)
+{
+	assert_not_null(qt);
+
+	quadtree_normalize_hard(qt);
+	quadtree_node_sums_refresh(qt);
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_count_t* node_counts = qt->node_counts;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+
+	uint32_t count = 0;
+
+	quadtree_count_node_info_t node_infos[qt->dfs_length];
+	quadtree_count_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_count_node_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
+	};
+
+	do
+	{
+		quadtree_count_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		/*
+		 * Every matching entity is counted once, in the node holding the
+		 * point of it closest to the query's min corner. Past the min
+		 * edges of the query that point is the entity's own min corner.
+		 */
+		if(
+			extent.min_x < info.bounds.min_x &&
+			extent.min_y < info.bounds.min_y &&
+			extent.max_x >= info.bounds.max_x &&
+			extent.max_y >= info.bounds.max_y
+			)
+		{
+			count += node_counts[info.node_idx].corners[0];
+			continue;
+		}
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend(extent);
+			quadtree_descend_spill();
+			continue;
+		}
+
+		uint32_t idx = node->head;
+		if(!idx)
+		{
+			continue;
+		}
+
+		quadtree_node_entity_t* node_entity = node_entities + idx;
+
+		while(1)
+		{
+			rect_extent_t entity_extent = quadtree_node_entity_extent(qt, node_entity);
+
+			count +=
+				rect_extent_intersects(entity_extent, extent) &&
+				quadtree_count_owns(info.bounds,
+					MACRO_MAX(entity_extent.min_x, extent.min_x),
+					MACRO_MAX(entity_extent.min_y, extent.min_y));
+
+			if(node_entity->is_last)
+			{
+				break;
+			}
+			++node_entity;
+		}
+	}
+	while(node_info != node_infos);
+
+	return count;
+}
+
+
+uint32_t
+quadtree_count_circle(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float radius
+	)
+{
+	assert_not_null(qt);
+
+	quadtree_normalize_hard(qt);
+	quadtree_node_sums_refresh(qt);
+
+	float radius_sq = radius * radius;
+
+	rect_extent_t search_extent =
+	{
+		.min_x = x - radius,
+		.min_y = y - radius,
+		.max_x = x + radius,
+		.max_y = y + radius
+	};
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_count_t* node_counts = qt->node_counts;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+
+	uint32_t count = 0;
+
+	quadtree_count_node_info_t node_infos[qt->dfs_length];
+	quadtree_count_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_count_node_info_t)
 	{
 		.node_idx = 0,
-		.extent = qt->half_extent
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
+	};
+
+	do
+	{
+		quadtree_count_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		if(quadtree_point_to_extent_distance_sq(x, y, info.bounds) > radius_sq)
+		{
+			continue;
+		}
+
+		/*
+		 * Entities are owned by the point of them closest to the center.
+		 * In a node off to one side of the center on both axes that is
+		 * always the same corner, which the node counts already hold.
+		 */
+		bool right = info.bounds.min_x > x;
+		bool top = info.bounds.min_y > y;
+
+		float far_x = MACRO_MAX(x - info.bounds.min_x, info.bounds.max_x - x);
+		float far_y = MACRO_MAX(y - info.bounds.min_y, info.bounds.max_y - y);
+
+		if(
+			(right || info.bounds.max_x <= x) &&
+			(top || info.bounds.max_y <= y) &&
+			far_x * far_x + far_y * far_y <= radius_sq
+			)
+		{
+			count += node_counts[info.node_idx].corners[(!right << 1) | !top];
+			continue;
+		}
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend(search_extent);
+			quadtree_descend_spill();
+			continue;
+		}
+
+		uint32_t idx = node->head;
+		if(!idx)
+		{
+			continue;
+		}
+
+		quadtree_node_entity_t* node_entity = node_entities + idx;
+
+		while(1)
+		{
+			rect_extent_t entity_extent = quadtree_node_entity_extent(qt, node_entity);
+
+			count +=
+				quadtree_point_to_extent_distance_sq(x, y, entity_extent) <= radius_sq &&
+				quadtree_count_owns(info.bounds,
+					MACRO_MIN(MACRO_MAX(x, entity_extent.min_x), entity_extent.max_x),
+					MACRO_MIN(MACRO_MAX(y, entity_extent.min_y), entity_extent.max_y));
+
+			if(node_entity->is_last)
+			{
+				break;
+			}
+			++node_entity;
+		}
+	}
+	while(node_info != node_infos);
+
+	return count;
+}
+
+
+#ifdef quadtree_node_aggregate
+
+
+void
+quadtree_query_aggregate(
+	quadtree_t* qt,
+	quadtree_aggregate_fn_t aggregate_fn,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(aggregate_fn);
+	assert_not_null(query_fn);
+
+	quadtree_normalize_hard(qt);
+	quadtree_node_sums_refresh(qt);
+
+	quadtree_node_t* nodes = qt->nodes;
+	quadtree_node_aggregate* node_aggregates = qt->node_aggregates;
+	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
+	quadtree_entity_t* entities = qt->entities;
+
+	quadtree_count_node_info_t node_infos[qt->dfs_length];
+	quadtree_count_node_info_t* node_info = node_infos;
+
+	*(node_info++) =
+	(quadtree_count_node_info_t)
+	{
+		.node_idx = 0,
+		.extent = qt->half_extent,
+		.bounds = { .min_x = -INFINITY, .min_y = -INFINITY, .max_x = INFINITY, .max_y = INFINITY }
 	};
 
-	do
-	{
-		quadtree_node_info_t info = *(--node_info);
-		quadtree_node_t* node = nodes + info.node_idx;
+	do
+	{
+		quadtree_count_node_info_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
+
+		if(node->type == QUADTREE_NODE_TYPE_LEAF && !node->head)
+		{
+			continue;
+		}
+
+		quadtree_node_info_t aggregate_info =
+		{
+			.node_idx = info.node_idx,
+			.extent = info.extent
+		};
+
+		quadtree_aggregate_action_t action = aggregate_fn(qt, &aggregate_info, node_aggregates + info.node_idx, user_data);
+		if(action == QUADTREE_AGGREGATE_ACCEPT)
+		{
+			continue;
+		}
+
+		if(action == QUADTREE_AGGREGATE_STOP)
+		{
+			return;
+		}
+
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		{
+			quadtree_descend_all();
+			quadtree_descend_spill();
+			continue;
+		}
+
+		quadtree_node_entity_t* node_entity = node_entities + node->head;
+
+		while(1)
+		{
+			uint32_t entity_idx = node_entity->index;
+			quadtree_entity_t* entity = entities + entity_idx;
+			rect_extent_t entity_extent = quadtree_node_entity_extent(qt, node_entity);
+
+			/* Same owner as in the aggregates, so nothing is visited twice */
+			if(quadtree_count_owns(info.bounds,
+				(entity_extent.min_x + entity_extent.max_x) * 0.5f,
+				(entity_extent.min_y + entity_extent.max_y) * 0.5f))
+			{
+				quadtree_entity_info_t entity_info =
+				{
+					.idx = entity_idx,
+					.data = quadtree_entity_payload(qt, entity)
+				};
+
+				quadtree_status_t status = query_fn(qt, entity_info, user_data);
+				if(status == QUADTREE_STATUS_CHANGED)
+				{
+					return;
+				}
+			}
+
+			if(node_entity->is_last)
+			{
+				break;
+			}
+			++node_entity;
+		}
+	}
+	while(node_info != node_infos);
+}
+
+
+void
+quadtree_invalidate_aggregates(
+	quadtree_t* qt
+	)
+{
+	assert_not_null(qt);
+
+	qt->node_sums_valid = false;
+	qt->stale_nodes_used = 0;
+}
+
+
+#endif
+
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
+
+
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+
+
+typedef struct quadtree_ht
+{
+	uint32_t* buckets;
+	uint32_t buckets_size;
+	uint32_t mask;
+
+	quadtree_ht_entry_t* entries;
+	uint32_t entries_used;
+	uint32_t entries_size;
+}
+quadtree_ht_t;
+
+
+void
+quadtree_ht_init(
+	quadtree_ht_t* ht,
+	uint32_t count
+	)
+{
+	uint32_t buckets_size = MACRO_NEXT_OR_EQUAL_POWER_OF_2(MACRO_MAX(count, 1));
+	ht->mask = buckets_size - 1;
+	assert_true(MACRO_IS_POWER_OF_2(buckets_size));
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+	/* Only the first buckets_size buckets are hashed into */
+	if(ht->buckets_size < buckets_size)
+	{
+		alloc_free(ht->buckets, ht->buckets_size);
+		ht->buckets = quadtree_heap_call(alloc_malloc(ht->buckets, buckets_size));
+		assert_ptr(ht->buckets, buckets_size);
+
+		ht->buckets_size = buckets_size;
+	}
+
+	memset(ht->buckets, 0, sizeof(*ht->buckets) * buckets_size);
+#else
+	ht->buckets_size = buckets_size;
+
+	ht->buckets = quadtree_heap_call(alloc_calloc(ht->buckets, ht->buckets_size));
+	assert_ptr(ht->buckets, ht->buckets_size);
+#endif
+
+	ht->entries_used = 1;
+}
+
+
+void
+quadtree_ht_free(
+	quadtree_ht_t* ht
+	)
+{
+#if QUADTREE_SCRATCH_ARENAS == 0
+	if(ht->entries_used * 4 <= ht->entries_size)
+	{
+		uint32_t new_size = ht->entries_size >> 1;
+
+		ht->entries = quadtree_heap_call(alloc_remalloc(ht->entries, ht->entries_size, new_size));
+		assert_not_null(ht->entries);
+
+		ht->entries_size = new_size;
+	}
+
+	alloc_free(ht->buckets, ht->buckets_size);
+#endif
+}
+
+
+bool
+quadtree_ht_insert(
+	quadtree_ht_t* ht,
+	uint32_t index_a,
+	uint32_t index_b
+	)
+{
+	if(index_a > index_b)
+	{
+		uint32_t temp = index_a;
+		index_a = index_b;
+		index_b = temp;
+	}
+
+	uint32_t hash = index_a * 48611 + index_b * 50261;
+	hash &= ht->mask;
+
+	uint32_t index = ht->buckets[hash];
+	quadtree_ht_entry_t* entry;
+
+	while(index)
+	{
+		entry = ht->entries + index;
+
+		if(entry->idx[0] == index_a && entry->idx[1] == index_b)
+		{
+			return false;
+		}
+
+		index = entry->next;
+	}
+
+	if(ht->entries_used >= ht->entries_size)
+	{
+		uint32_t new_size = (ht->entries_used << 1) | 3;
+		assert_neq(new_size, ht->entries_size);
+
+		ht->entries = quadtree_heap_call(alloc_remalloc(ht->entries, ht->entries_size, new_size));
+		assert_not_null(ht->entries);
+
+		ht->entries_size = new_size;
+	}
+
+	uint32_t entry_idx = ht->entries_used++;
+	entry = ht->entries + entry_idx;
+
+	entry->idx[0] = index_a;
+	entry->idx[1] = index_b;
+	entry->next = ht->buckets[hash];
+	ht->buckets[hash] = entry_idx;
+
+	return true;
+}
+
+
+#endif
+
+
+typedef struct quadtree_collide_task
+{
+	quadtree_t* qt;
+	quadtree_collide_fn_t collide_fn;
+	void* user_data;
+	bool deterministic;
+	bool parallel;
+#if QUADTREE_DEDUPE_COLLISIONS == 2
+	quadtree_subtree_t* subtrees;
+	uint32_t subtrees_used;
+#elif QUADTREE_BRANCH_ENTITIES == 1
+	uint32_t branches_used;
+#endif
+}
+quadtree_collide_task_t;
+
+
+typedef struct quadtree_collider
+{
+	quadtree_collide_task_t* task;
+	quadtree_thread_t* thread;
+#if QUADTREE_BRANCH_ENTITIES == 1
+	bool in_branch;
+#endif
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	quadtree_ht_t ht;
+#elif QUADTREE_DEDUPE_COLLISIONS == 2
+	rect_extent_t bounds;
+	uint32_t position_flags;
+#endif
+}
+quadtree_collider_t;
+
+
+#if QUADTREE_DEDUPE_COLLISIONS == 2
+
+
+bool
+quadtree_collide_owns(
+	quadtree_collider_t* collider,
+	rect_extent_t a,
+	rect_extent_t b
+	)
+{
+	float x = MACRO_MAX(a.min_x, b.min_x);
+	float y = MACRO_MAX(a.min_y, b.min_y);
+
+	rect_extent_t bounds = collider->bounds;
+	uint32_t position_flags = collider->position_flags;
+
+	return
+		(x >= bounds.min_x || (position_flags & 0b0001)) &&
+		(y >= bounds.min_y || (position_flags & 0b0010)) &&
+		(x < bounds.max_x || (position_flags & 0b0100)) &&
+		(y < bounds.max_y || (position_flags & 0b1000));
+}
+
+
+#endif
+
+
+void
+quadtree_collide_pair(
+	quadtree_collider_t* collider,
+	uint32_t entity_idx,
+	uint32_t other_entity_idx
+	)
+{
+	quadtree_collide_task_t* task = collider->task;
+	quadtree_t* qt = task->qt;
+
+	quadtree_entity_t* entity = qt->entities + entity_idx;
+	quadtree_entity_t* other_entity = qt->entities + other_entity_idx;
 
-		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+	bool defer = task->deterministic;
+
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	if(entity->in_nodes_minus_one || other_entity->in_nodes_minus_one)
+	{
+		if(!quadtree_ht_insert(&collider->ht, entity_idx, other_entity_idx))
 		{
-			quadtree_descend_all();
-			continue;
+			return;
 		}
 
-		if(!node->head)
+		defer = task->parallel;
+	}
+#elif QUADTREE_DEDUPE_COLLISIONS == 0
+	/* Other threads may be reporting pairs of the same entity from its other nodes */
+	if(entity->in_nodes_minus_one || other_entity->in_nodes_minus_one)
+	{
+		defer = task->parallel;
+	}
+#elif QUADTREE_DEDUPE_COLLISIONS == 2
+	if(entity->in_nodes_minus_one || other_entity->in_nodes_minus_one)
+	{
+		if(!quadtree_collide_owns(collider,
+			quadtree_entity_extent(qt, entity, entity_idx),
+			quadtree_entity_extent(qt, other_entity, other_entity_idx)))
 		{
-			continue;
+			return;
 		}
 
-		rect_extent_t node_extent = half_to_rect_extent(info.extent);
+		/* The entity's other nodes may be in subtrees of other threads */
+		defer = task->parallel;
+	}
+#endif
 
-		do
+#if QUADTREE_BRANCH_ENTITIES == 1
+	/* Both entities' own nodes may be gone through by other threads */
+	if(collider->in_branch)
+	{
+		defer = task->parallel;
+	}
+#endif
+
+	if(!defer)
+	{
+		quadtree_entity_info_t entity_info =
 		{
-			++node_entities_next;
-			++node_entities;
-			++node_entities_flags;
+			.idx = entity_idx,
+			.data = quadtree_entity_payload(qt, entity)
+		};
+		quadtree_entity_info_t other_entity_info =
+		{
+			.idx = other_entity_idx,
+			.data = quadtree_entity_payload(qt, other_entity)
+		};
+		task->collide_fn(qt, entity_info, other_entity_info, task->user_data);
 
-			uint32_t entity_idx = node_entities->index;
-			quadtree_entity_t* entity = entities + entity_idx;
+		return;
+	}
 
-			if(entity->update_tick != update_tick)
-			{
-				entity->update_tick = update_tick;
-				entity->reinsertion_tick = update_tick ^ 1;
+	quadtree_thread_t* thread = collider->thread;
 
-				quadtree_entity_info_t entity_info =
-				{
-					.idx = entity_idx,
-					.data = &entity->data
-				};
-				entity->status = update_fn(qt, entity_info, user_data);
-			}
+	if(thread->collisions_used >= thread->collisions_size)
+	{
+		uint32_t new_size = (thread->collisions_used << 1) | 3;
+		assert_neq(new_size, thread->collisions_size);
 
-			if(entity->status == QUADTREE_STATUS_NOT_CHANGED)
-			{
-				continue;
-			}
+		thread->collisions = quadtree_heap_call(alloc_remalloc(thread->collisions, thread->collisions_size, new_size));
+		assert_not_null(thread->collisions);
 
-			rect_extent_t extent = quadtree_get_entity_rect_extent(entity);
+		thread->collisions_size = new_size;
+	}
 
-			uint8_t old_flags = *node_entities_flags;
-			uint8_t pos_flags = node->position_flags;
+	uint32_t collision_idx = thread->collisions_used++;
+	quadtree_collision_t* collision = thread->collisions + collision_idx;
 
-			uint8_t new_flags =
-				((-(uint8_t)(extent.max_y >= node_extent.max_y)) & 0b1000 & ~pos_flags) |
-				((-(uint8_t)(extent.max_x >= node_extent.max_x)) & 0b0100 & ~pos_flags) |
-				((-(uint8_t)(extent.min_y <= node_extent.min_y)) & 0b0010 & ~pos_flags) |
-				((-(uint8_t)(extent.min_x <= node_extent.min_x)) & 0b0001 & ~pos_flags);
+	collision->idx[0] = entity_idx;
+	collision->idx[1] = other_entity_idx;
+}
 
-			*node_entities_flags = new_flags;
-			bool crossed_new_boundary = new_flags & ~old_flags;
 
-			if(crossed_new_boundary && entity->reinsertion_tick != update_tick)
-			{
-				entity->reinsertion_tick = update_tick;
+#if QUADTREE_SIMD_COLLIDE == 1
 
-				uint32_t reinsertion_idx;
-				quadtree_reinsertion_t* reinsertion;
 
-				if(reinsertions_used >= reinsertions_size)
-				{
-					uint32_t new_size = (reinsertions_used << 1) | 3;
-					assert_neq(new_size, reinsertions_size);
+uint32_t
+quadtree_simd_intersects(
+	const float* extents,
+	uint32_t stride,
+	rect_extent_t extent
+	)
+{
+	const float* min_x = extents;
+	const float* min_y = min_x + stride;
+	const float* max_x = min_y + stride;
+	const float* max_y = max_x + stride;
+
+#ifdef __AVX512F__
+	__mmask16 mask = _mm512_cmp_ps_mask(
+		_mm512_set1_ps(extent.max_x), _mm512_loadu_ps(min_x), _CMP_GE_OQ);
+	mask = _mm512_mask_cmp_ps_mask(mask,
+		_mm512_set1_ps(extent.max_y), _mm512_loadu_ps(min_y), _CMP_GE_OQ);
+	mask = _mm512_mask_cmp_ps_mask(mask,
+		_mm512_loadu_ps(max_x), _mm512_set1_ps(extent.min_x), _CMP_GE_OQ);
+	mask = _mm512_mask_cmp_ps_mask(mask,
+		_mm512_loadu_ps(max_y), _mm512_set1_ps(extent.min_y), _CMP_GE_OQ);
+
+	return mask;
+#else
+	__m256 hit = _mm256_cmp_ps(
+		_mm256_set1_ps(extent.max_x), _mm256_loadu_ps(min_x), _CMP_GE_OQ);
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(
+		_mm256_set1_ps(extent.max_y), _mm256_loadu_ps(min_y), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(
+		_mm256_loadu_ps(max_x), _mm256_set1_ps(extent.min_x), _CMP_GE_OQ));
+	hit = _mm256_and_ps(hit, _mm256_cmp_ps(
+		_mm256_loadu_ps(max_y), _mm256_set1_ps(extent.min_y), _CMP_GE_OQ));
+
+	return _mm256_movemask_ps(hit);
+#endif
+}
 
-					reinsertions = alloc_remalloc(reinsertions, reinsertions_size, new_size);
-					assert_not_null(reinsertions);
 
-					reinsertions_size = new_size;
-				}
+void
+quadtree_collide_span(
+	quadtree_collider_t* collider,
+	quadtree_node_entity_t* node_entity,
+	uint32_t count
+	)
+{
+	quadtree_thread_t* thread = collider->thread;
+	quadtree_t* qt = collider->task->qt;
 
-				reinsertion_idx = reinsertions_used++;
-				reinsertion = reinsertions + reinsertion_idx;
+	uint32_t stride = count + QUADTREE_SIMD_WIDTH;
+	uint32_t extents_size = stride * 4;
 
-				reinsertion->entity_idx = entity_idx;
+	if(thread->extents_size < extents_size)
+	{
+		alloc_free(thread->extents, thread->extents_size);
 
-				qt->normalization |= QUADTREE_NOT_NORMALIZED_HARD;
-			}
+		thread->extents_size = extents_size << 1;
+		thread->extents = quadtree_heap_call(alloc_malloc(thread->extents, thread->extents_size));
+		assert_ptr(thread->extents, thread->extents_size);
+	}
 
-			if(
-				(extent.max_x < node_extent.min_x && !(node->position_flags & 0b0001)) ||
-				(extent.max_y < node_extent.min_y && !(node->position_flags & 0b0010)) ||
-				(node_extent.max_x < extent.min_x && !(node->position_flags & 0b0100)) ||
-				(node_extent.max_y < extent.min_y && !(node->position_flags & 0b1000))
-				)
-			{
-				uint32_t node_removal_idx;
-				quadtree_node_removal_t* node_removal;
+	float* min_x = thread->extents;
+	float* min_y = min_x + stride;
+	float* max_x = min_y + stride;
+	float* max_y = max_x + stride;
 
-				if(node_removals_used >= node_removals_size)
-				{
-					uint32_t new_size = (node_removals_used << 1) | 3;
-					assert_neq(new_size, node_removals_size);
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		rect_extent_t extent = quadtree_node_entity_extent(qt, node_entity + i);
 
-					node_removals = alloc_remalloc(node_removals, node_removals_size, new_size);
-					assert_not_null(node_removals);
+		min_x[i] = extent.min_x;
+		min_y[i] = extent.min_y;
+		max_x[i] = extent.max_x;
+		max_y[i] = extent.max_y;
+	}
 
-					node_removals_size = new_size;
-				}
+	for(uint32_t i = count; i < stride; ++i)
+	{
+		min_x[i] = 0.0f;
+		min_y[i] = 0.0f;
+		max_x[i] = 0.0f;
+		max_y[i] = 0.0f;
+	}
 
-				node_removal_idx = node_removals_used++;
-				node_removal = node_removals + node_removal_idx;
+	for(uint32_t i = 0; i < count - 1; ++i)
+	{
+		uint32_t entity_idx = node_entity[i].index;
+		rect_extent_t entity_extent =
+		{
+			.min_x = min_x[i],
+			.min_y = min_y[i],
+			.max_x = max_x[i],
+			.max_y = max_y[i]
+		};
 
-				uint32_t idx = node_entities_flags - node_entities_flags_copy;
+		for(uint32_t j = i + 1; j < count; j += QUADTREE_SIMD_WIDTH)
+		{
+			uint32_t mask = quadtree_simd_intersects(min_x + j, stride, entity_extent);
 
-				node_removal->node_idx = info.node_idx;
-				node_removal->node_entity_idx = idx;
-				node_removal->entity_idx = entity_idx;
+			if(count - j < QUADTREE_SIMD_WIDTH)
+			{
+				mask &= (1U << (count - j)) - 1;
+			}
 
-				qt->normalization |= QUADTREE_NOT_NORMALIZED_HARD;
+			while(mask)
+			{
+				uint32_t other_node_entity_idx = j + __builtin_ctz(mask);
+				mask &= mask - 1;
+
+				quadtree_collide_pair(collider, entity_idx, node_entity[other_node_entity_idx].index);
 			}
 		}
-		while(*node_entities_next);
 	}
-	while(node_info != node_infos);
+}
 
-	qt->reinsertions = reinsertions;
-	qt->reinsertions_used = reinsertions_used;
-	qt->reinsertions_size = reinsertions_size;
 
-	qt->node_removals = node_removals;
-	qt->node_removals_used = node_removals_used;
-	qt->node_removals_size = node_removals_size;
-}
+#endif
 
 
 void
-quadtree_query_rect(
-	quadtree_t* qt,
-	rect_extent_t extent,
-	quadtree_query_fn_t query_fn,
-	void* user_data
+quadtree_collide_range(
+	quadtree_collider_t* collider,
+	uint32_t node_entity_idx,
+	uint32_t node_entity_end
 	)
 {
-	assert_not_null(qt);
-	assert_not_null(query_fn);
+	quadtree_t* qt = collider->task->qt;
 
-	quadtree_normalize_hard(qt);
-
-	++qt->query_tick;
-	uint32_t query_tick = qt->query_tick;
-
-	quadtree_node_t* nodes = qt->nodes;
 	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
-	quadtree_entity_t* entities = qt->entities;
 
-	quadtree_node_info_t node_infos[qt->dfs_length];
-	quadtree_node_info_t* node_info = node_infos;
+	quadtree_node_entity_t* node_entity = node_entities + node_entity_idx;
+	quadtree_node_entity_t* node_entities_end = node_entities + node_entity_end;
 
-	*(node_info++) =
-	(quadtree_node_info_t)
-	{
-		.node_idx = 0,
-		.extent = qt->half_extent
-	};
+#if QUADTREE_SIMD_COLLIDE == 1
+	quadtree_node_entity_t* span_end = node_entity - 1;
+#endif
 
-	do
+	for(; node_entity != node_entities_end; ++node_entity)
 	{
-		quadtree_node_info_t info = *(--node_info);
-		quadtree_node_t* node = nodes + info.node_idx;
-
-		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		if(node_entity->is_last)
 		{
-			quadtree_descend(extent);
 			continue;
 		}
 
-		uint32_t idx = node->head;
-		if(!idx)
+#if QUADTREE_SIMD_COLLIDE == 1
+		if(node_entity > span_end)
 		{
-			continue;
-		}
+			span_end = node_entity;
 
-		quadtree_node_entity_t* node_entity = node_entities + idx;
+			while(!span_end->is_last)
+			{
+				++span_end;
+			}
 
-		while(1)
-		{
-			uint32_t entity_idx = node_entity->index;
-			quadtree_entity_t* entity = entities + entity_idx;
+			uint32_t count = span_end - node_entity + 1;
 
-			if(entity->query_tick != query_tick)
+			if(count >= QUADTREE_SIMD_MIN_COUNT)
 			{
-				entity->query_tick = query_tick;
-
-				if(rect_extent_intersects(quadtree_get_entity_rect_extent(entity), extent))
-				{
-					quadtree_entity_info_t entity_info =
-					{
-						.idx = entity_idx,
-						.data = &entity->data
-					};
+				quadtree_collide_span(collider, node_entity, count);
 
-					quadtree_status_t status = query_fn(qt, entity_info, user_data);
-					if(status == QUADTREE_STATUS_CHANGED)
-					{
-						return;
-					}
-				}
+				node_entity = span_end;
+				continue;
 			}
+		}
+#endif
 
-			if(node_entity->is_last)
+		uint32_t entity_idx = node_entity->index;
+		rect_extent_t entity_extent = quadtree_node_entity_extent(qt, node_entity);
+
+		quadtree_node_entity_t* other_node_entity = node_entity;
+
+		do
+		{
+			++other_node_entity;
+
+			uint32_t other_entity_idx = other_node_entity->index;
+
+			if(
+				quadtree_node_entity_may_intersect(node_entity, other_node_entity->extent) &&
+				rect_extent_intersects(entity_extent, quadtree_node_entity_extent(qt, other_node_entity))
+				)
 			{
-				break;
+				quadtree_collide_pair(collider, entity_idx, other_entity_idx);
 			}
-			++node_entity;
 		}
+		while(!other_node_entity->is_last);
 	}
-	while(node_info != node_infos);
 }
 
 
-float
-quadtree_point_to_extent_distance_sq(
-	float x,
-	float y,
-	rect_extent_t extent
-	)
-{
-	float dx = MACRO_MAX(MACRO_MAX(extent.min_x - x, 0.0f), x - extent.max_x);
-	float dy = MACRO_MAX(MACRO_MAX(extent.min_y - y, 0.0f), y - extent.max_y);
-	return dx * dx + dy * dy;
-}
+#if QUADTREE_BRANCH_ENTITIES == 1
+
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_subtree(__VA_ARGS__)
 
 
 void
-quadtree_query_circle(
-	quadtree_t* qt,
-	float x,
-	float y,
-	float radius,
-	quadtree_query_fn_t query_fn,
-	void* user_data
+quadtree_collide_branch(
+	quadtree_collider_t* collider,
+	quadtree_subtree_t branch
 	)
 {
-	assert_not_null(qt);
-	assert_not_null(query_fn);
-
-	quadtree_normalize_hard(qt);
-
-	++qt->query_tick;
-	uint32_t query_tick = qt->query_tick;
-
-	float radius_sq = radius * radius;
-
-	rect_extent_t search_extent =
-	{
-		.min_x = x - radius,
-		.min_y = y - radius,
-		.max_x = x + radius,
-		.max_y = y + radius
-	};
-
+	quadtree_t* qt = collider->task->qt;
 	quadtree_node_t* nodes = qt->nodes;
 	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
-	quadtree_entity_t* entities = qt->entities;
 
-	quadtree_node_info_t node_infos[qt->dfs_length];
-	quadtree_node_info_t* node_info = node_infos;
+	quadtree_node_t* spill = nodes + nodes[branch.node_idx].children + 4;
+	quadtree_node_entity_t* spill_entities = node_entities + spill->head;
+	quadtree_node_entity_t* spill_entities_end = spill_entities + spill->count;
 
-	*(node_info++) =
-	(quadtree_node_info_t)
-	{
-		.node_idx = 0,
-		.extent = qt->half_extent
-	};
+	quadtree_subtree_t node_infos[qt->dfs_length];
+	quadtree_subtree_t* node_info = node_infos;
 
-	do
 	{
-		quadtree_node_info_t info = *(--node_info);
+		quadtree_subtree_t info = branch;
 		quadtree_node_t* node = nodes + info.node_idx;
 
-		rect_extent_t node_extent = half_to_rect_extent(info.extent);
+		quadtree_descend_all();
+	}
 
-		if(quadtree_point_to_extent_distance_sq(x, y, node_extent) > radius_sq)
-		{
-			continue;
-		}
+	collider->in_branch = true;
+
+	/* Every node below the branch, its entities can only meet the branch's ones here */
+	do
+	{
+		quadtree_subtree_t info = *(--node_info);
+		quadtree_node_t* node = nodes + info.node_idx;
 
 		if(node->type != QUADTREE_NODE_TYPE_LEAF)
 		{
-			quadtree_descend(search_extent);
+			quadtree_descend_all();
+			quadtree_descend_spill();
 			continue;
 		}
 
-		uint32_t idx = node->head;
-		if(!idx)
+		if(!node->head)
 		{
 			continue;
 		}
 
-		quadtree_node_entity_t* node_entity = node_entities + idx;
+#if QUADTREE_DEDUPE_COLLISIONS == 2
+		collider->bounds = info.bounds;
+		collider->position_flags = node->position_flags;
+#endif
 
-		while(1)
+		quadtree_node_entity_t* other_node_entities = node_entities + node->head;
+		quadtree_node_entity_t* other_node_entities_end = other_node_entities + node->count;
+
+		for(quadtree_node_entity_t* node_entity = spill_entities; node_entity != spill_entities_end; ++node_entity)
 		{
-			uint32_t entity_idx = node_entity->index;
-			quadtree_entity_t* entity = entities + entity_idx;
+			rect_extent_t entity_extent = quadtree_node_entity_extent(qt, node_entity);
 
-			if(entity->query_tick != query_tick)
+			for(
+				quadtree_node_entity_t* other_node_entity = other_node_entities;
+				other_node_entity != other_node_entities_end;
+				++other_node_entity
+				)
 			{
-				entity->query_tick = query_tick;
+				if(rect_extent_intersects(entity_extent, quadtree_node_entity_extent(qt, other_node_entity)))
+				{
+					quadtree_collide_pair(collider, node_entity->index, other_node_entity->index);
+				}
+			}
+		}
+	}
+	while(node_info != node_infos);
 
-				rect_extent_t entity_extent = quadtree_get_entity_rect_extent(entity);
+	collider->in_branch = false;
+}
 
-				float edx = MACRO_MAX(MACRO_MAX(entity_extent.min_x - x, 0.0f), x - entity_extent.max_x);
-				float edy = MACRO_MAX(MACRO_MAX(entity_extent.min_y - y, 0.0f), y - entity_extent.max_y);
 
-				if(edx * edx + edy * edy <= radius_sq)
-				{
-					quadtree_entity_info_t entity_info =
-					{
-						.idx = entity_idx,
-						.data = &entity->data
-					};
+#if QUADTREE_DEDUPE_COLLISIONS != 2
 
-					quadtree_status_t status = query_fn(qt, entity_info, user_data);
-					if(status == QUADTREE_STATUS_CHANGED)
-					{
-						return;
-					}
-				}
-			}
 
-			if(node_entity->is_last)
-			{
-				break;
-			}
-			++node_entity;
+uint32_t
+quadtree_collide_branches_used(
+	quadtree_t* qt
+	)
+{
+	quadtree_node_t* nodes = qt->nodes;
+
+	uint32_t node_infos[qt->dfs_length];
+	uint32_t* node_info = node_infos;
+
+	*(node_info++) = 0;
+
+	uint32_t branches_used = 0;
+
+	do
+	{
+		quadtree_node_t* node = nodes + *(--node_info);
+
+		if(node->type == QUADTREE_NODE_TYPE_LEAF)
+		{
+			continue;
+		}
+
+		branches_used += !!nodes[node->children + 4].head;
+
+		for(uint32_t i = 0; i < 4; ++i)
+		{
+			*(node_info++) = node->children + i;
 		}
 	}
 	while(node_info != node_infos);
+
+	return branches_used;
 }
 
 
 void
-quadtree_query_nodes_rect(
-	quadtree_t* qt,
-	rect_extent_t extent,
-	quadtree_node_query_fn_t node_query_fn,
-	void* user_data
+quadtree_collide_branches(
+	quadtree_collider_t* collider,
+	uint32_t branch_idx,
+	uint32_t branch_end
 	)
 {
-	assert_not_null(qt);
-	assert_not_null(node_query_fn);
-
-	quadtree_normalize_hard(qt);
-
+	quadtree_t* qt = collider->task->qt;
 	quadtree_node_t* nodes = qt->nodes;
 
-	quadtree_node_info_t node_infos[qt->dfs_length];
-	quadtree_node_info_t* node_info = node_infos;
+	quadtree_subtree_t node_infos[qt->dfs_length];
+	quadtree_subtree_t* node_info = node_infos;
 
 	*(node_info++) =
-	(quadtree_node_info_t)
+	(quadtree_subtree_t)
 	{
 		.node_idx = 0,
-		.extent = qt->half_extent
+		.extent = qt->half_extent,
+		.bounds = half_to_rect_extent(qt->half_extent)
 	};
 
+	/*
+	 * Branches holding entities are numbered in the order they are reached,
+	 * so that consecutive ranges of them keep the serial order of pairs
+	 */
+	uint32_t current_branch_idx = 0;
+
 	do
 	{
-		quadtree_node_info_t info = *(--node_info);
+		quadtree_subtree_t info = *(--node_info);
 		quadtree_node_t* node = nodes + info.node_idx;
 
-		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		if(node->type == QUADTREE_NODE_TYPE_LEAF)
 		{
-			quadtree_descend(extent);
 			continue;
 		}
 
-		quadtree_status_t status = node_query_fn(qt, &info, user_data);
-		if(status == QUADTREE_STATUS_CHANGED)
+		if(nodes[node->children + 4].head)
 		{
-			return;
+			if(current_branch_idx == branch_end)
+			{
+				return;
+			}
+
+			if(current_branch_idx++ >= branch_idx)
+			{
+				quadtree_collide_branch(collider, info);
+			}
 		}
+
+		quadtree_descend_all();
 	}
 	while(node_info != node_infos);
 }
 
 
+#endif
+
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
+
+
+#endif
+
+
+#if QUADTREE_DEDUPE_COLLISIONS == 2
+
+
 void
-quadtree_query_nodes_circle(
-	quadtree_t* qt,
-	float x,
-	float y,
-	float radius,
-	quadtree_node_query_fn_t node_query_fn,
-	void* user_data
+quadtree_collide_subtree(
+	quadtree_collider_t* collider,
+	quadtree_subtree_t subtree
 	)
 {
-	assert_not_null(qt);
-	assert_not_null(node_query_fn);
+	quadtree_t* qt = collider->task->qt;
+	quadtree_node_t* nodes = qt->nodes;
 
-	quadtree_normalize_hard(qt);
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_subtree(__VA_ARGS__)
 
-	float radius_sq = radius * radius;
+	quadtree_subtree_t node_infos[qt->dfs_length];
+	quadtree_subtree_t* node_info = node_infos;
 
-	rect_extent_t search_extent =
+#if QUADTREE_BRANCH_ENTITIES == 1
+	if(subtree.spill)
 	{
-		.min_x = x - radius,
-		.min_y = y - radius,
-		.max_x = x + radius,
-		.max_y = y + radius
-	};
-
-	quadtree_node_t* nodes = qt->nodes;
+		quadtree_collide_branch(collider, subtree);
 
-	quadtree_node_info_t node_infos[qt->dfs_length];
-	quadtree_node_info_t* node_info = node_infos;
+		subtree.node_idx = nodes[subtree.node_idx].children + 4;
+	}
+#endif
 
-	*(node_info++) =
-	(quadtree_node_info_t)
-	{
-		.node_idx = 0,
-		.extent = qt->half_extent
-	};
+	*(node_info++) = subtree;
 
 	do
 	{
-		quadtree_node_info_t info = *(--node_info);
+		quadtree_subtree_t info = *(--node_info);
 		quadtree_node_t* node = nodes + info.node_idx;
 
-		rect_extent_t node_extent = half_to_rect_extent(info.extent);
-
-		if(quadtree_point_to_extent_distance_sq(x, y, node_extent) > radius_sq)
+		if(node->type != QUADTREE_NODE_TYPE_LEAF)
 		{
+#if QUADTREE_BRANCH_ENTITIES == 1
+			if(nodes[node->children + 4].head)
+			{
+				quadtree_collide_branch(collider, info);
+			}
+#endif
+
+			quadtree_descend_all();
+			quadtree_descend_spill();
 			continue;
 		}
 
-		if(node->type != QUADTREE_NODE_TYPE_LEAF)
+		if(node->count <= 1)
 		{
-			quadtree_descend(search_extent);
 			continue;
 		}
 
-		quadtree_status_t status = node_query_fn(qt, &info, user_data);
-		if(status == QUADTREE_STATUS_CHANGED)
-		{
-			return;
-		}
+		collider->bounds = info.bounds;
+		collider->position_flags = node->position_flags;
+
+		quadtree_collide_range(collider, node->head, node->head + node->count);
 	}
 	while(node_info != node_infos);
+
+#undef quadtree_fill_node
+#define quadtree_fill_node(...)			\
+quadtree_fill_node_default(__VA_ARGS__)
 }
 
 
+#endif
+
+
 void
 quadtree_collide(
 	quadtree_t* qt,
@@ -1759,146 +7290,302 @@ quadtree_collide(
 
 	quadtree_normalize_hard(qt);
 
-	if(qt->entities_used <= 1)
+	if(qt->entities_used <= 1 || qt->node_entities_used <= 1)
 	{
 		return;
 	}
 
+	quadtree_collide_task_t task =
+	{
+		.qt = qt,
+		.collide_fn = collide_fn,
+		.user_data = user_data
+	};
+
+	quadtree_collider_t collider =
+	{
+		.task = &task,
+		.thread = qt->threads
+	};
+
 #if QUADTREE_DEDUPE_COLLISIONS == 1
-	uint32_t ht_size = MACRO_NEXT_OR_EQUAL_POWER_OF_2(MACRO_MAX(qt->ht_entries_used * 2, 1));
-	uint32_t ht_mask = ht_size - 1;
-	assert_true(MACRO_IS_POWER_OF_2(ht_size));
+	collider.ht.entries = qt->ht_entries;
+	collider.ht.entries_size = qt->ht_entries_size;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	collider.ht.buckets = qt->ht_buckets;
+	collider.ht.buckets_size = qt->ht_buckets_size;
+#endif
 
-	uint32_t* ht = alloc_calloc(ht, ht_size);
-	assert_ptr(ht, ht_size);
+	quadtree_ht_init(&collider.ht, qt->ht_entries_used * 2);
+#endif
+
+#if QUADTREE_DEDUPE_COLLISIONS == 2
+	quadtree_collide_subtree(&collider,
+		(quadtree_subtree_t)
+		{
+			.node_idx = 0,
+			.extent = qt->half_extent,
+			.bounds = half_to_rect_extent(qt->half_extent)
+		});
+#else
+	quadtree_collide_range(&collider, 1, qt->node_entities_used);
 
-	quadtree_ht_entry_t* ht_entries = qt->ht_entries;
+#if QUADTREE_BRANCH_ENTITIES == 1
+	quadtree_collide_branches(&collider, 0, UINT32_MAX);
+#endif
+#endif
 
-	uint32_t ht_entries_used = 1;
-	uint32_t ht_entries_size = qt->ht_entries_size;
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	quadtree_ht_free(&collider.ht);
+
+	qt->ht_entries = collider.ht.entries;
+	qt->ht_entries_used = collider.ht.entries_used;
+	qt->ht_entries_size = collider.ht.entries_size;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	qt->ht_buckets = collider.ht.buckets;
+	qt->ht_buckets_size = collider.ht.buckets_size;
 #endif
+#endif
+}
 
+
+uint32_t
+quadtree_collide_boundary(
+	quadtree_t* qt,
+	uint32_t thread_idx
+	)
+{
+	uint32_t node_entities_used = qt->node_entities_used;
 	quadtree_node_entity_t* node_entities = qt->node_entities.entities;
-	quadtree_entity_t* entities = qt->entities;
 
-	quadtree_node_entity_t* node_entity = node_entities;
-	quadtree_node_entity_t* node_entities_end = node_entities + qt->node_entities_used - 1;
+	uint32_t node_entity_idx = 1 + (uint64_t)(node_entities_used - 1) * thread_idx / qt->thread_count;
 
-	do
+	while(
+		node_entity_idx != 1 &&
+		node_entity_idx < node_entities_used &&
+		!node_entities[node_entity_idx - 1].is_last
+		)
 	{
-		++node_entity;
-		if(node_entity->is_last)
-		{
-			continue;
-		}
+		++node_entity_idx;
+	}
 
-		uint32_t entity_idx = node_entity->index;
-		quadtree_entity_t* entity = entities + entity_idx;
-		rect_extent_t entity_extent = quadtree_get_entity_rect_extent(entity);
-		quadtree_entity_info_t entity_info =
-		{
-			.idx = entity_idx,
-			.data = &entity->data
-		};
+	return node_entity_idx;
+}
 
-		quadtree_node_entity_t* other_node_entity = node_entity;
 
-		do
-		{
-			++other_node_entity;
+void
+quadtree_collide_parallel_fn(
+	void* data,
+	uint32_t thread_idx
+	)
+{
+	quadtree_collide_task_t* task = data;
+	quadtree_t* qt = task->qt;
+	quadtree_thread_t* thread = qt->threads + thread_idx;
 
-			uint32_t other_entity_idx = other_node_entity->index;
-			quadtree_entity_t* other_entity = entities + other_entity_idx;
+	thread->collisions_used = 0;
+
+	quadtree_collider_t collider =
+	{
+		.task = task,
+		.thread = thread
+	};
+
+#if QUADTREE_DEDUPE_COLLISIONS == 2
+	uint32_t subtree_idx = task->subtrees_used * thread_idx / qt->thread_count;
+	uint32_t subtree_end = task->subtrees_used * (thread_idx + 1) / qt->thread_count;
+
+	for(; subtree_idx != subtree_end; ++subtree_idx)
+	{
+		quadtree_collide_subtree(&collider, task->subtrees[subtree_idx]);
+	}
+#else
+	uint32_t node_entity_idx = quadtree_collide_boundary(qt, thread_idx);
+	uint32_t node_entity_end = quadtree_collide_boundary(qt, thread_idx + 1);
+
+#if QUADTREE_BRANCH_ENTITIES == 0
+	/* Otherwise there still is a share of the branches to go through */
+	if(node_entity_idx == node_entity_end)
+	{
+		return;
+	}
+#endif
+
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	collider.ht.entries = thread->ht_entries;
+	collider.ht.entries_size = thread->ht_entries_size;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	collider.ht.buckets = thread->ht_buckets;
+	collider.ht.buckets_size = thread->ht_buckets_size;
+#endif
+
+	quadtree_ht_init(&collider.ht, thread->ht_entries_used * 2);
+#endif
+
+	quadtree_collide_range(&collider, node_entity_idx, node_entity_end);
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+	thread->branch_collisions_idx = thread->collisions_used;
+
+	quadtree_collide_branches(&collider,
+		(uint64_t) task->branches_used * thread_idx / qt->thread_count,
+		(uint64_t) task->branches_used * (thread_idx + 1) / qt->thread_count);
+#endif
+#endif
+
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	quadtree_ht_free(&collider.ht);
+
+	thread->ht_entries = collider.ht.entries;
+	thread->ht_entries_used = collider.ht.entries_used;
+	thread->ht_entries_size = collider.ht.entries_size;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	thread->ht_buckets = collider.ht.buckets;
+	thread->ht_buckets_size = collider.ht.buckets_size;
+#endif
+#endif
+}
+
+
+void
+quadtree_collide_parallel(
+	quadtree_t* qt,
+	quadtree_collide_fn_t collide_fn,
+	void* user_data,
+	bool deterministic
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(collide_fn);
+
+	if(qt->thread_count <= 1)
+	{
+		quadtree_collide(qt, collide_fn, user_data);
+		return;
+	}
+
+	quadtree_normalize_hard(qt);
+
+	if(qt->entities_used <= 1 || qt->node_entities_used <= 1)
+	{
+		return;
+	}
+
+	quadtree_collide_task_t task =
+	{
+		.qt = qt,
+		.collide_fn = collide_fn,
+		.user_data = user_data,
+		.deterministic = deterministic,
+		.parallel = true
+	};
+
+#if QUADTREE_DEDUPE_COLLISIONS == 2
+	uint32_t subtrees_target = qt->thread_count * 16;
+	quadtree_subtree_t subtrees[subtrees_target * QUADTREE_NODE_BLOCK];
+
+	task.subtrees = subtrees;
+	task.subtrees_used = quadtree_subtrees(qt, subtrees, subtrees_target);
+#elif QUADTREE_BRANCH_ENTITIES == 1
+	task.branches_used = quadtree_collide_branches_used(qt);
+#endif
+
+	pool_run(&qt->pool, quadtree_collide_parallel_fn, &task);
 
-			if(!rect_extent_intersects(
-				entity_extent,
-				quadtree_get_entity_rect_extent(other_entity)
-				))
-			{
-				continue;
-			}
+	uint32_t collisions_used = 0;
 
-#if QUADTREE_DEDUPE_COLLISIONS == 1
-			if(entity->in_nodes_minus_one || other_entity->in_nodes_minus_one)
-			{
-				uint32_t index_a = entity_idx;
-				uint32_t index_b = other_entity_idx;
+	for(uint32_t i = 0; i < qt->thread_count; ++i)
+	{
+		collisions_used += qt->threads[i].collisions_used;
+	}
 
-				if(index_a > index_b)
-				{
-					uint32_t temp = index_a;
-					index_a = index_b;
-					index_b = temp;
-				}
+	if(!collisions_used)
+	{
+		return;
+	}
 
-				uint32_t hash = index_a * 48611 + index_b * 50261;
-				hash &= ht_mask;
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	quadtree_ht_t ht =
+	{
+		.entries = qt->ht_entries,
+		.entries_size = qt->ht_entries_size,
+#if QUADTREE_SCRATCH_ARENAS == 1
+		.buckets = qt->ht_buckets,
+		.buckets_size = qt->ht_buckets_size
+#endif
+	};
 
-				uint32_t index = ht[hash];
-				quadtree_ht_entry_t* entry;
+	quadtree_ht_init(&ht, collisions_used * 2);
+#endif
 
-				while(index)
-				{
-					entry = ht_entries + index;
+	quadtree_entity_t* entities = qt->entities;
 
-					if(entry->idx[0] == index_a && entry->idx[1] == index_b)
-					{
-						goto goto_skip;
-					}
+	uint32_t segments = qt->thread_count;
+#if QUADTREE_BRANCH_ENTITIES == 1 && QUADTREE_DEDUPE_COLLISIONS != 2
+	/* Every thread's pairs from leaves, then every thread's pairs from branches, as quadtree_collide finds them */
+	segments <<= 1;
+#endif
 
-					index = entry->next;
-				}
+	for(uint32_t i = 0; i < segments; ++i)
+	{
+		quadtree_thread_t* thread = qt->threads + i % qt->thread_count;
 
-				if(ht_entries_used >= ht_entries_size)
-				{
-					uint32_t new_size = (ht_entries_used << 1) | 3;
-					assert_neq(new_size, ht_entries_size);
+		quadtree_collision_t* collision = thread->collisions;
+		quadtree_collision_t* collision_end = collision + thread->collisions_used;
 
-					ht_entries = alloc_remalloc(ht_entries, ht_entries_size, new_size);
-					assert_not_null(ht_entries);
+#if QUADTREE_BRANCH_ENTITIES == 1 && QUADTREE_DEDUPE_COLLISIONS != 2
+		if(i < qt->thread_count)
+		{
+			collision_end = collision + thread->branch_collisions_idx;
+		}
+		else
+		{
+			collision += thread->branch_collisions_idx;
+		}
+#endif
 
-					ht_entries_size = new_size;
-				}
+		for(; collision != collision_end; ++collision)
+		{
+			uint32_t entity_idx = collision->idx[0];
+			uint32_t other_entity_idx = collision->idx[1];
 
-				uint32_t entry_idx = ht_entries_used++;
-				entry = ht_entries + entry_idx;
+			quadtree_entity_t* entity = entities + entity_idx;
+			quadtree_entity_t* other_entity = entities + other_entity_idx;
 
-				entry->idx[0] = index_a;
-				entry->idx[1] = index_b;
-				entry->next = ht[hash];
-				ht[hash] = entry_idx;
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+			if(
+				(entity->in_nodes_minus_one || other_entity->in_nodes_minus_one) &&
+				!quadtree_ht_insert(&ht, entity_idx, other_entity_idx)
+				)
+			{
+				continue;
 			}
 #endif
 
+			quadtree_entity_info_t entity_info =
+			{
+				.idx = entity_idx,
+				.data = quadtree_entity_payload(qt, entity)
+			};
 			quadtree_entity_info_t other_entity_info =
 			{
 				.idx = other_entity_idx,
-				.data = &other_entity->data
+				.data = quadtree_entity_payload(qt, other_entity)
 			};
 			collide_fn(qt, entity_info, other_entity_info, user_data);
-
-			goto_skip:;
 		}
-		while(!other_node_entity->is_last);
 	}
-	while(node_entity != node_entities_end);
 
 #if QUADTREE_DEDUPE_COLLISIONS == 1
-	if(ht_entries_used * 4 <= ht_entries_size)
-	{
-		uint32_t new_size = ht_entries_size >> 1;
-
-		ht_entries = alloc_remalloc(ht_entries, ht_entries_size, new_size);
-		assert_not_null(ht_entries);
-
-		ht_entries_size = new_size;
-	}
-
-	qt->ht_entries = ht_entries;
-	qt->ht_entries_used = ht_entries_used;
-	qt->ht_entries_size = ht_entries_size;
-
-	alloc_free(ht, ht_size);
+	quadtree_ht_free(&ht);
+
+	qt->ht_entries = ht.entries;
+	qt->ht_entries_used = ht.entries_used;
+	qt->ht_entries_size = ht.entries_size;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	qt->ht_buckets = ht.buckets;
+	qt->ht_buckets_size = ht.buckets_size;
+#endif
 #endif
 }
 
@@ -1985,9 +7672,60 @@ quadtree_search_cmp(
 }
 
 
+heap_t
+quadtree_search_heap_begin(
+	quadtree_query_scratch_t* scratch
+	)
+{
+#if QUADTREE_SCRATCH_ARENAS == 1
+	if(!scratch->heap.temp)
+	{
+		scratch->heap.cmp_fn = (void*) quadtree_search_cmp;
+		scratch->heap.el_size = sizeof(quadtree_search_item_t);
+		heap_init(&scratch->heap);
+
+		scratch->heap.keep_size = true;
+	}
+
+	scratch->heap.used = 0;
+
+	return scratch->heap;
+#else
+	(void) scratch;
+
+	heap_t heap;
+	heap.cmp_fn = (void*) quadtree_search_cmp;
+	heap.el_size = sizeof(quadtree_search_item_t);
+	heap_init(&heap);
+
+	return heap;
+#endif
+}
+
+
 void
-quadtree_nearest_rect(
-	quadtree_t* qt,
+quadtree_search_heap_end(
+	quadtree_query_scratch_t* scratch,
+	heap_t* heap
+	)
+{
+#if QUADTREE_SCRATCH_ARENAS == 1
+	__atomic_add_fetch(&quadtree_heap_calls, heap->allocs, __ATOMIC_RELAXED);
+	heap->allocs = 0;
+
+	scratch->heap = *heap;
+#else
+	(void) scratch;
+
+	heap_free(heap);
+#endif
+}
+
+
+void
+quadtree_nearest_rect_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
 	rect_extent_t extent,
 	uint32_t max_results,
 	quadtree_query_fn_t query_fn,
@@ -1995,6 +7733,7 @@ quadtree_nearest_rect(
 	)
 {
 	assert_not_null(qt);
+	assert_not_null(scratch);
 	assert_not_null(query_fn);
 
 	if(!max_results)
@@ -2002,22 +7741,19 @@ quadtree_nearest_rect(
 		return;
 	}
 
-	quadtree_normalize_hard(qt);
+	assert_lt(qt->normalization, QUADTREE_NOT_NORMALIZED_HARD);
 
-	++qt->query_tick;
-	uint32_t query_tick = qt->query_tick;
+	uint32_t query_tick = quadtree_query_scratch_begin(qt, scratch);
+	uint32_t* query_ticks = scratch->ticks;
 
-	heap_t heap;
-	heap.cmp_fn = (void*) quadtree_search_cmp;
-	heap.el_size = sizeof(quadtree_search_item_t);
-	heap_init(&heap);
+	heap_t heap = quadtree_search_heap_begin(scratch);
 
 	float center_x = (extent.min_x + extent.max_x) * 0.5f;
 	float center_y = (extent.min_y + extent.max_y) * 0.5f;
 
 	if(!rect_extent_intersects(qt->rect_extent, extent))
 	{
-		heap_free(&heap);
+		quadtree_search_heap_end(scratch, &heap);
 		return;
 	}
 
@@ -2051,10 +7787,10 @@ quadtree_nearest_rect(
 			quadtree_entity_info_t entity_info =
 			{
 				.idx = entity_idx,
-				.data = &entity->data
+				.data = quadtree_entity_payload(qt, entity)
 			};
 
-			quadtree_status_t status = query_fn(qt, entity_info, user_data);
+			quadtree_status_t status = query_fn((quadtree_t*) qt, entity_info, user_data);
 			++results_found;
 
 			if(status == QUADTREE_STATUS_CHANGED || results_found >= max_results)
@@ -2092,13 +7828,27 @@ quadtree_nearest_rect(
 						&(quadtree_search_item_t)
 						{
 							.value = d,
-							.idx = node->heads[i],
+							.idx = node->children + i,
 							.extent = child_ext
 						}
 						);
 				}
 			}
 
+#if QUADTREE_BRANCH_ENTITIES == 1
+			if(nodes[node->children + 4].head)
+			{
+				heap_push(&heap,
+					&(quadtree_search_item_t)
+					{
+						.value = current.value,
+						.idx = node->children + 4,
+						.extent = current.extent
+					}
+					);
+			}
+#endif
+
 			continue;
 		}
 
@@ -2113,13 +7863,12 @@ quadtree_nearest_rect(
 		while(1)
 		{
 			uint32_t entity_idx = node_entity->index;
-			quadtree_entity_t* entity = entities + entity_idx;
 
-			if(entity->query_tick != query_tick)
+			if(query_ticks[entity_idx] != query_tick)
 			{
-				entity->query_tick = query_tick;
+				query_ticks[entity_idx] = query_tick;
 
-				rect_extent_t ent_rect = quadtree_get_entity_rect_extent(entity);
+				rect_extent_t ent_rect = quadtree_node_entity_extent(qt, node_entity);
 
 				if(rect_extent_intersects(ent_rect, extent))
 				{
@@ -2143,13 +7892,31 @@ quadtree_nearest_rect(
 		}
 	}
 
-	heap_free(&heap);
+	quadtree_search_heap_end(scratch, &heap);
 }
 
 
 void
-quadtree_nearest_circle(
+quadtree_nearest_rect(
 	quadtree_t* qt,
+	rect_extent_t extent,
+	uint32_t max_results,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+
+	quadtree_normalize_hard(qt);
+
+	quadtree_nearest_rect_concurrent(qt, &qt->query_scratch, extent, max_results, query_fn, user_data);
+}
+
+
+void
+quadtree_nearest_circle_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
 	float x,
 	float y,
 	float max_distance,
@@ -2159,6 +7926,7 @@ quadtree_nearest_circle(
 	)
 {
 	assert_not_null(qt);
+	assert_not_null(scratch);
 	assert_not_null(query_fn);
 
 	if(!max_results)
@@ -2166,10 +7934,10 @@ quadtree_nearest_circle(
 		return;
 	}
 
-	quadtree_normalize_hard(qt);
+	assert_lt(qt->normalization, QUADTREE_NOT_NORMALIZED_HARD);
 
-	++qt->query_tick;
-	uint32_t query_tick = qt->query_tick;
+	uint32_t query_tick = quadtree_query_scratch_begin(qt, scratch);
+	uint32_t* query_ticks = scratch->ticks;
 
 	float root_dist = quadtree_point_to_extent_distance_sq(x, y, qt->rect_extent);
 	float max_dist_sq = (max_distance < 0.0f) ? INFINITY : (max_distance * max_distance);
@@ -2179,10 +7947,7 @@ quadtree_nearest_circle(
 		return;
 	}
 
-	heap_t heap;
-	heap.cmp_fn = (void*) quadtree_search_cmp;
-	heap.el_size = sizeof(quadtree_search_item_t);
-	heap_init(&heap);
+	heap_t heap = quadtree_search_heap_begin(scratch);
 
 	heap_push(&heap,
 		&(quadtree_search_item_t)
@@ -2217,10 +7982,10 @@ quadtree_nearest_circle(
 			quadtree_entity_info_t entity_info =
 			{
 				.idx = entity_idx,
-				.data = &entity->data
+				.data = quadtree_entity_payload(qt, entity)
 			};
 
-			quadtree_status_t status = query_fn(qt, entity_info, user_data);
+			quadtree_status_t status = query_fn((quadtree_t*) qt, entity_info, user_data);
 			++results_found;
 
 			if(status == QUADTREE_STATUS_CHANGED || results_found >= max_results)
@@ -2255,13 +8020,27 @@ quadtree_nearest_circle(
 						&(quadtree_search_item_t)
 						{
 							.value = d,
-							.idx = node->heads[i],
+							.idx = node->children + i,
 							.extent = child_ext
 						}
 						);
 				}
 			}
 
+#if QUADTREE_BRANCH_ENTITIES == 1
+			if(nodes[node->children + 4].head)
+			{
+				heap_push(&heap,
+					&(quadtree_search_item_t)
+					{
+						.value = current.value,
+						.idx = node->children + 4,
+						.extent = current.extent
+					}
+					);
+			}
+#endif
+
 			continue;
 		}
 
@@ -2276,13 +8055,12 @@ quadtree_nearest_circle(
 		while(1)
 		{
 			uint32_t entity_idx = node_entity->index;
-			quadtree_entity_t* entity = entities + entity_idx;
 
-			if(entity->query_tick != query_tick)
+			if(query_ticks[entity_idx] != query_tick)
 			{
-				entity->query_tick = query_tick;
+				query_ticks[entity_idx] = query_tick;
 
-				rect_extent_t ent_rect = quadtree_get_entity_rect_extent(entity);
+				rect_extent_t ent_rect = quadtree_node_entity_extent(qt, node_entity);
 				float dist = quadtree_point_to_extent_distance_sq(x, y, ent_rect);
 
 				if(dist <= max_dist_sq)
@@ -2305,28 +8083,49 @@ quadtree_nearest_circle(
 		}
 	}
 
-	heap_free(&heap);
+	quadtree_search_heap_end(scratch, &heap);
 }
 
 
 void
-quadtree_raycast(
+quadtree_nearest_circle(
 	quadtree_t* qt,
 	float x,
 	float y,
-	float dx,
-	float dy,
+	float max_distance,
+	uint32_t max_results,
 	quadtree_query_fn_t query_fn,
 	void* user_data
 	)
 {
 	assert_not_null(qt);
-	assert_not_null(query_fn);
 
 	quadtree_normalize_hard(qt);
 
-	++qt->query_tick;
-	uint32_t query_tick = qt->query_tick;
+	quadtree_nearest_circle_concurrent(qt, &qt->query_scratch, x, y, max_distance, max_results, query_fn, user_data);
+}
+
+
+void
+quadtree_raycast_run(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	float x,
+	float y,
+	float dx,
+	float dy,
+	quadtree_query_fn_t query_fn,
+	void* user_data,
+	quadtree_query_buffer_t* buffer
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(scratch);
+
+	assert_lt(qt->normalization, QUADTREE_NOT_NORMALIZED_HARD);
+
+	uint32_t query_tick = quadtree_query_scratch_begin(qt, scratch);
+	uint32_t* query_ticks = scratch->ticks;
 
 	float inv_dx = 1.0f / dx;
 	float inv_dy = 1.0f / dy;
@@ -2377,7 +8176,7 @@ quadtree_raycast(
 			float half_w = current.extent.w * 0.5f;
 			float half_h = current.extent.h * 0.5f;
 
-			quadtree_ray_node_info_t children[4];
+			quadtree_ray_node_info_t children[QUADTREE_NODE_BLOCK];
 			uint32_t child_count = 0;
 
 			for(uint32_t i = 0; i < 4; ++i)
@@ -2407,13 +8206,64 @@ quadtree_raycast(
 					children[child_count++] =
 					(quadtree_ray_node_info_t)
 					{
-						.node_idx = node->heads[i],
+						.node_idx = node->children + i,
 						.extent = child_ext,
 						.t_min = MACRO_MAX(c_t_min, 0.0f)
 					};
 				}
 			}
 
+#if QUADTREE_BRANCH_ENTITIES == 1
+			/* The branch's own entities span its children, so they go in by the nearest one the ray enters */
+			uint32_t spill_head = nodes[node->children + 4].head;
+
+			if(spill_head)
+			{
+				float spill_t_min = INFINITY;
+				quadtree_node_entity_t* node_entity = node_entities + spill_head;
+
+				while(1)
+				{
+					if(query_ticks[node_entity->index] != query_tick)
+					{
+						rect_extent_t r = quadtree_node_entity_extent(qt, node_entity);
+
+						float t1 = (r.min_x - x) * inv_dx;
+						float t2 = (r.max_x - x) * inv_dx;
+						float e_t_min = MACRO_MIN(t1, t2);
+						float e_t_max = MACRO_MAX(t1, t2);
+
+						t1 = (r.min_y - y) * inv_dy;
+						t2 = (r.max_y - y) * inv_dy;
+						e_t_min = MACRO_MAX(e_t_min, MACRO_MIN(t1, t2));
+						e_t_max = MACRO_MIN(e_t_max, MACRO_MAX(t1, t2));
+
+						if(e_t_max >= e_t_min && e_t_max >= 0.0f && e_t_min <= 1.0f)
+						{
+							spill_t_min = MACRO_MIN(spill_t_min, MACRO_MAX(e_t_min, 0.0f));
+						}
+					}
+
+					if(node_entity->is_last)
+					{
+						break;
+					}
+					++node_entity;
+				}
+
+				if(spill_t_min != INFINITY)
+				{
+					children[child_count++] =
+					(quadtree_ray_node_info_t)
+					{
+						.node_idx = node->children + 4,
+						.extent = current.extent,
+						.t_min = spill_t_min
+					};
+				}
+			}
+#endif
+
 			if(!child_count)
 			{
 				continue;
@@ -2453,11 +8303,11 @@ quadtree_raycast(
 			uint32_t entity_idx = node_entity->index;
 			quadtree_entity_t* entity = entities + entity_idx;
 
-			if(entity->query_tick != query_tick)
+			if(query_ticks[entity_idx] != query_tick)
 			{
-				entity->query_tick = query_tick;
+				query_ticks[entity_idx] = query_tick;
 
-				rect_extent_t r = quadtree_get_entity_rect_extent(entity);
+				rect_extent_t r = quadtree_node_entity_extent(qt, node_entity);
 
 				float t1 = (r.min_x - x) * inv_dx;
 				float t2 = (r.max_x - x) * inv_dx;
@@ -2471,15 +8321,25 @@ quadtree_raycast(
 
 				if(e_t_max >= e_t_min && e_t_max >= 0.0f && e_t_min <= 1.0f)
 				{
-					quadtree_entity_info_t entity_info =
+					if(buffer)
 					{
-						.idx = entity_idx,
-						.data = &entity->data
-					};
-
-					if(query_fn(qt, entity_info, user_data) == QUADTREE_STATUS_CHANGED)
+						if(quadtree_query_buffer_push(buffer, entity_idx, quadtree_entity_payload(qt, entity)))
+						{
+							return;
+						}
+					}
+					else
 					{
-						return;
+						quadtree_entity_info_t entity_info =
+						{
+							.idx = entity_idx,
+							.data = quadtree_entity_payload(qt, entity)
+						};
+
+						if(query_fn((quadtree_t*) qt, entity_info, user_data) == QUADTREE_STATUS_CHANGED)
+						{
+							return;
+						}
 					}
 				}
 			}
@@ -2494,18 +8354,100 @@ quadtree_raycast(
 }
 
 
+void
+quadtree_raycast_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	float x,
+	float y,
+	float dx,
+	float dy,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(query_fn);
+
+	quadtree_raycast_run(qt, scratch, x, y, dx, dy, query_fn, user_data, NULL);
+}
+
+
+uint32_t
+quadtree_raycast_collect(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float dx,
+	float dy,
+	quadtree_query_buffer_t* buffer
+	)
+{
+	assert_not_null(qt);
+	assert_not_null(buffer);
+
+	quadtree_normalize_hard(qt);
+
+	buffer->used = 0;
+	quadtree_raycast_run(qt, &qt->query_scratch, x, y, dx, dy, NULL, NULL, buffer);
+
+	return buffer->used;
+}
+
+
+void
+quadtree_raycast(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float dx,
+	float dy,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	)
+{
+	assert_not_null(qt);
+
+	quadtree_normalize_hard(qt);
+
+	quadtree_raycast_concurrent(qt, &qt->query_scratch, x, y, dx, dy, query_fn, user_data);
+}
+
+
+typedef struct quadtree_check_count
+{
+	uint32_t entity_idx;
+	uint32_t count;
+}
+quadtree_check_count_t;
+
+
 quadtree_status_t
 quadtree_check_count_node(
 	quadtree_t* qt,
 	const quadtree_node_info_t* info,
+	bool covered,
 	void* user_data
 	)
 {
+	(void) covered;
+	quadtree_check_count_t* check_count = user_data;
+
+#if QUADTREE_BRANCH_ENTITIES == 1
+	/* Nodes below the one holding the entity are reached too, without it */
+	uint32_t node_entity_idx = qt->nodes[info->node_idx].head;
+
+	while(node_entity_idx && qt->node_entities.entities[node_entity_idx].index != check_count->entity_idx)
+	{
+		node_entity_idx = qt->node_entities.next[node_entity_idx];
+	}
+
+	check_count->count += !!node_entity_idx;
+#else
 	(void) qt;
 	(void) info;
-	uint32_t* check_count = user_data;
 
-	++(*check_count);
+	++check_count->count;
+#endif
 
 	return QUADTREE_STATUS_NOT_CHANGED;
 }
@@ -2523,12 +8465,43 @@ quadtree_check_in_nodes_count(
 	for(i = 1; i < entities_used; ++i)
 	{
 		quadtree_entity_t* entity = entities + i;
-		rect_extent_t extent = quadtree_get_entity_rect_extent(entity);
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+		if(entity->in_nodes_minus_one == QUADTREE_ENTITY_FREE)
+		{
+			continue;
+		}
+#endif
+		rect_extent_t extent = quadtree_get_entity_tree_extent(qt, entity, i);
 
-		uint32_t check_count = 0;
+		quadtree_check_count_t check_count =
+		{
+			.entity_idx = i
+		};
 		quadtree_query_nodes_rect(qt, extent, quadtree_check_count_node, &check_count);
 
-		hard_assert_eq(check_count - 1, entity->in_nodes_minus_one);
+		hard_assert_eq(check_count.count - 1, entity->in_nodes_minus_one);
+		hard_assert_eq(qt->handles[entity->handle_idx].entity_idx, i);
+
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+		uint32_t linked = 0;
+		uint32_t node_entity_idx = entity->node_entity;
+
+		while(node_entity_idx)
+		{
+			quadtree_node_entity_link_t link = qt->node_entities.links[node_entity_idx];
+			quadtree_node_t* node = qt->nodes + link.node_idx;
+
+			hard_assert_eq(qt->node_entities.entities[node_entity_idx].index, i);
+			hard_assert_eq(node->type, QUADTREE_NODE_TYPE_LEAF);
+			hard_assert_ge(node_entity_idx, node->head);
+			hard_assert_lt(node_entity_idx, node->head + node->count);
+
+			++linked;
+			node_entity_idx = link.next;
+		}
+
+		hard_assert_eq(linked, check_count.count);
+#endif
 	}
 }
 
@@ -2546,9 +8519,33 @@ quadtree_check(
 }
 
 
+#undef QUADTREE_NODE_BLOCK
+#undef QUADTREE_QUERY_BATCH_SIZE
+#undef QUADTREE_UPDATE_BATCH_SIZE
+#undef quadtree_get_entity_tree_extent
+#undef quadtree_node_entity_may_intersect
+#undef quadtree_copy_node_entity_extent
+#undef quadtree_set_node_entity_extent
+#undef quadtree_node_entity_extent
+#undef quadtree_sync_entity_extent
+#undef quadtree_entity_payload
+#undef quadtree_entity_extent
+#undef quadtree_mark_dirty
 #undef quadtree_reset_flags
+#undef quadtree_fill_subtree
+#undef quadtree_descend_spill
 #undef quadtree_descend_extentless
 #undef quadtree_descend_all
 #undef quadtree_descend
 #undef quadtree_fill_node
 #undef quadtree_fill_node_default
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	#undef QUADTREE_ENTITY_FREE
+	#undef QUADTREE_NODE_DIRTY
+#endif
+
+#if QUADTREE_SIMD_COLLIDE == 1
+	#undef QUADTREE_SIMD_MIN_COUNT
+	#undef QUADTREE_SIMD_WIDTH
+#endif
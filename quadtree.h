@@ -16,35 +16,104 @@
 
 #pragma once
 
+#include "pool.h"
+#include "heap.h"
 #include "extent.h"
 #include "alloc/include/alloc/macro.h"
 
+/* 0 = off, 1 = hash table, 2 = report only in the leaf owning the overlap's min corner */
 #ifndef QUADTREE_DEDUPE_COLLISIONS
 	#define QUADTREE_DEDUPE_COLLISIONS 1
 #endif
 
+#ifndef QUADTREE_INCREMENTAL_NORMALIZE
+	#define QUADTREE_INCREMENTAL_NORMALIZE 0
+#endif
+
+/* Entities keep their nodes until they leave an extent inflated by qt->looseness times
+ * their half size, kept between the smallest leaf's and the one of the leaf holding them */
+#ifndef QUADTREE_LOOSE
+	#define QUADTREE_LOOSE 0
+#endif
+
+/* Entities at least qt->branch_entity_size children wide or tall stay in the
+ * branch they reach instead of being copied into every leaf below it */
+#ifndef QUADTREE_BRANCH_ENTITIES
+	#define QUADTREE_BRANCH_ENTITIES 0
+#endif
+
+/* Entities chain through their node entities, so removing one doesn't descend the tree */
+#ifndef QUADTREE_NODE_ENTITY_LINKS
+	#define QUADTREE_NODE_ENTITY_LINKS 0
+#endif
+
+/* The normalize rebuild visits leaves along a Hilbert curve rather than
+ * in child order, so nodes and entities close in space stay close in memory */
+#ifndef QUADTREE_HILBERT_ORDER
+	#define QUADTREE_HILBERT_ORDER 0
+#endif
+
+/* Keeps entity extents in a dense array and payloads out of line, indexed by handle */
+#ifndef QUADTREE_ENTITY_SOA
+	#define QUADTREE_ENTITY_SOA 0
+#endif
+
+/* Node entities carry a copy of their entity's extent so scans don't chase the index,
+ * 1 = floats, 2 = 16 bit fixed point relative to the leaf, only used to reject early */
+#ifndef QUADTREE_NODE_ENTITY_EXTENT
+	#define QUADTREE_NODE_ENTITY_EXTENT 0
+#endif
+
+/* Normalize, collide and the nearest queries keep their scratch buffers in the tree
+ * between calls and only ever grow them, so a warmed up tick makes no heap calls */
+#ifndef QUADTREE_SCRATCH_ARENAS
+	#define QUADTREE_SCRATCH_ARENAS 0
+#endif
+
+#ifndef QUADTREE_HANDLE_INDEX_BITS
+	#define QUADTREE_HANDLE_INDEX_BITS 24
+#endif
+
+#define QUADTREE_HANDLE_INDEX_MASK ((1U << QUADTREE_HANDLE_INDEX_BITS) - 1)
+#define QUADTREE_HANDLE_GENERATION_MASK (UINT32_MAX >> QUADTREE_HANDLE_INDEX_BITS)
+
+#ifndef QUADTREE_SIMD_COLLIDE
+	#if defined(__AVX512F__) || defined(__AVX2__)
+		#define QUADTREE_SIMD_COLLIDE 1
+	#else
+		#define QUADTREE_SIMD_COLLIDE 0
+	#endif
+#endif
+
 
 typedef enum quadtree_node_type
 {
 	QUADTREE_NODE_TYPE_LEAF,
+	QUADTREE_NODE_TYPE_BRANCH,
 	MACRO_ENUM_BITS(QUADTREE_NODE_TYPE)
 }
 quadtree_node_type_t;
 
 
+/*
+ * Siblings are allocated as a block of 4, a branch only stores the first one's index.
+ * With QUADTREE_BRANCH_ENTITIES a 5th leaf follows them, holding the branch's entities.
+ */
 typedef union quadtree_node
 {
 	uint32_t next;
 
 	struct
 	{
-		uint32_t head;
+		union
+		{
+			uint32_t head;
+			uint32_t children;
+		};
 		uint32_t position_flags;
 		uint32_t count;
 		quadtree_node_type_t type;
 	};
-
-	uint32_t heads[4];
 }
 quadtree_node_t;
 
@@ -66,6 +135,24 @@ quadtree_node_t;
 	#define quadtree_get_entity_data_rect_extent(entity) (entity).rect_extent
 #endif
 
+/*
+ * Optional per-node summary of the entities centered in each node, like
+ * total mass for Barnes-Hut. Needs these, all taking pointers:
+ * quadtree_aggregate_reset(aggregate)
+ * quadtree_aggregate_add(aggregate, entity_data)
+ * quadtree_aggregate_combine(aggregate, child_aggregate)
+ * Summaries are only redone for entities an update reports as changed.
+ * Fields they read that change anywhere else, like in a query callback,
+ * must be followed by quadtree_invalidate_aggregates().
+ */
+#ifdef quadtree_node_aggregate
+	#if !defined(quadtree_aggregate_reset) || \
+		!defined(quadtree_aggregate_add) || \
+		!defined(quadtree_aggregate_combine)
+		#error "quadtree_node_aggregate needs quadtree_aggregate_reset, _add and _combine"
+	#endif
+#endif
+
 
 typedef enum quadtree_status : uint8_t
 {
@@ -76,16 +163,79 @@ typedef enum quadtree_status : uint8_t
 quadtree_status_t;
 
 
+typedef uint32_t quadtree_handle_t;
+
+
+typedef struct quadtree_handle_slot
+{
+	union
+	{
+		uint32_t entity_idx;
+		uint32_t next;
+	};
+
+	uint32_t generation;
+}
+quadtree_handle_slot_t;
+
+
+/* Lets the _concurrent queries run from many threads over a normalized tree, one scratch per thread */
+typedef struct quadtree_query_scratch
+{
+	uint32_t* ticks;
+	uint64_t* masks;
+	uint32_t ticks_size;
+	uint32_t masks_size;
+	uint32_t tick;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	heap_t heap;
+#endif
+}
+quadtree_query_scratch_t;
+
+
+/* Filled by the _collect queries, hits past max_results are dropped unless it is 0 */
+typedef struct quadtree_query_buffer
+{
+	uint32_t* idxs;
+	quadtree_entity_data** data;
+	uint32_t used;
+	uint32_t idxs_size;
+	uint32_t data_size;
+	uint32_t max_results;
+	bool collect_data;
+}
+quadtree_query_buffer_t;
+
+
+/* Entities per extent corner lying in a node, corner index picks max x with bit 1 and max y with bit 0 */
+typedef struct quadtree_node_count
+{
+	uint32_t corners[4];
+}
+quadtree_node_count_t;
+
+
 typedef struct quadtree_entity
 {
+#if QUADTREE_ENTITY_SOA == 1
+	uint32_t next;
+#else
 	union
 	{
 		quadtree_entity_data data;
 		uint32_t next;
 	};
+#endif
 
+	uint32_t handle_idx;
 	uint32_t in_nodes_minus_one;
-	uint32_t query_tick;
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	uint32_t node_entity;
+#endif
+#if QUADTREE_LOOSE == 1
+	rect_extent_t loose_extent;
+#endif
 	uint8_t update_tick;
 	uint8_t reinsertion_tick;
 	quadtree_status_t status;
@@ -93,8 +243,16 @@ typedef struct quadtree_entity
 quadtree_entity_t;
 
 
-#define quadtree_get_entity_rect_extent(entity)	\
-quadtree_get_entity_data_rect_extent((entity)->data)
+#if QUADTREE_ENTITY_SOA == 1
+	#define quadtree_get_entity_data(qt, entity_idx)	\
+	((qt)->entity_data + (qt)->entities[entity_idx].handle_idx)
+#else
+	#define quadtree_get_entity_rect_extent(entity)	\
+	quadtree_get_entity_data_rect_extent((entity)->data)
+
+	#define quadtree_get_entity_data(qt, entity_idx)	\
+	(&(qt)->entities[entity_idx].data)
+#endif
 
 
 typedef struct quadtree_node_info
@@ -113,6 +271,13 @@ typedef struct quadtree_ht_entry
 quadtree_ht_entry_t;
 
 
+typedef struct quadtree_collision
+{
+	uint32_t idx[2];
+}
+quadtree_collision_t;
+
+
 typedef struct quadtree_removal
 {
 	uint32_t entity_idx;
@@ -129,20 +294,116 @@ typedef struct quadtree_node_removal
 quadtree_node_removal_t;
 
 
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	typedef struct quadtree_dirty_node
+	{
+		uint32_t node_idx;
+		uint32_t head;
+		uint32_t count;
+	}
+	quadtree_dirty_node_t;
+#endif
+
+
+/* A node whose sums are out of date, found again from the root through a point inside it */
+typedef struct quadtree_stale_node
+{
+	uint32_t node_idx;
+	float x;
+	float y;
+}
+quadtree_stale_node_t;
+
+
 typedef struct quadtree_insertion
 {
+#if QUADTREE_ENTITY_SOA == 0
 	quadtree_entity_data data;
+#endif
+	uint32_t handle_idx;
 }
 quadtree_insertion_t;
 
 
+/* node_idx is the leaf the entity was queued from if it is staying in it, 0 otherwise */
 typedef struct quadtree_reinsertion
 {
 	uint32_t entity_idx;
+	uint32_t node_idx;
 }
 quadtree_reinsertion_t;
 
 
+typedef struct quadtree_update_deferral
+{
+	uint32_t node_idx;
+	uint32_t node_entity_idx;
+	rect_extent_t node_extent;
+}
+quadtree_update_deferral_t;
+
+
+typedef struct quadtree_update_change
+{
+	uint32_t entity_idx;
+	rect_extent_t extent;
+}
+quadtree_update_change_t;
+
+
+typedef struct quadtree_thread
+{
+	quadtree_reinsertion_t* reinsertions;
+	quadtree_node_removal_t* node_removals;
+	quadtree_update_deferral_t* update_deferrals;
+	quadtree_stale_node_t* stale_nodes;
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	quadtree_ht_entry_t* ht_entries;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	uint32_t* ht_buckets;
+#endif
+#endif
+	quadtree_collision_t* collisions;
+#if QUADTREE_SIMD_COLLIDE == 1
+	float* extents;
+#endif
+
+	uint32_t reinsertions_used;
+	uint32_t reinsertions_size;
+
+	uint32_t node_removals_used;
+	uint32_t node_removals_size;
+
+	uint32_t update_deferrals_used;
+	uint32_t update_deferrals_size;
+
+	uint32_t stale_nodes_used;
+	uint32_t stale_nodes_size;
+
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	uint32_t ht_entries_used;
+	uint32_t ht_entries_size;
+#if QUADTREE_SCRATCH_ARENAS == 1
+	uint32_t ht_buckets_size;
+#endif
+#endif
+
+	uint32_t collisions_used;
+	uint32_t collisions_size;
+#if QUADTREE_BRANCH_ENTITIES == 1 && QUADTREE_DEDUPE_COLLISIONS != 2
+	/* Where the pairs found against branches start, behind the ones from leaves */
+	uint32_t branch_collisions_idx;
+#endif
+
+#if QUADTREE_SIMD_COLLIDE == 1
+	uint32_t extents_size;
+#endif
+
+	quadtree_query_scratch_t query_scratch;
+}
+quadtree_thread_t;
+
+
 typedef struct quadtree_entity_info
 {
 	uint32_t idx;
@@ -162,10 +423,42 @@ typedef quadtree_status_t
 	);
 
 
+#ifdef quadtree_node_aggregate
+	typedef enum quadtree_aggregate_action : uint8_t
+	{
+		QUADTREE_AGGREGATE_ACCEPT,
+		QUADTREE_AGGREGATE_DESCEND,
+		QUADTREE_AGGREGATE_STOP,
+		MACRO_ENUM_BITS(QUADTREE_AGGREGATE)
+	}
+	quadtree_aggregate_action_t;
+
+
+	typedef quadtree_aggregate_action_t
+	(*quadtree_aggregate_fn_t)(
+		quadtree_t* qt,
+		const quadtree_node_info_t* info,
+		const quadtree_node_aggregate* aggregate,
+		void* user_data
+		);
+#endif
+
+
+typedef quadtree_status_t
+(*quadtree_query_batch_fn_t)(
+	quadtree_t* qt,
+	uint32_t query_idx,
+	quadtree_entity_info_t info,
+	void* user_data
+	);
+
+
+/* covered is set when every entity in the node is known to match the query */
 typedef quadtree_status_t
 (*quadtree_node_query_fn_t)(
 	quadtree_t* qt,
 	const quadtree_node_info_t* info,
+	bool covered,
 	void* user_data
 	);
 
@@ -187,19 +480,62 @@ typedef quadtree_status_t
 	);
 
 
+/* Returns a mask with bit i set if entity i of the batch changed */
+typedef uint64_t
+(*quadtree_update_batch_fn_t)(
+	quadtree_t* qt,
+	const uint32_t* idxs,
+	quadtree_entity_data** data,
+	uint32_t count,
+	void* user_data
+	);
+
+
+#if QUADTREE_NODE_ENTITY_EXTENT == 2
+	/* Rounded outwards and clamped to the leaf, 0 and 65535 being its edges */
+	typedef struct quadtree_quantized_extent
+	{
+		uint16_t min_x;
+		uint16_t min_y;
+		uint16_t max_x;
+		uint16_t max_y;
+	}
+	quadtree_quantized_extent_t;
+#endif
+
+
 typedef struct quadtree_node_entity
 {
 	uint32_t index:31;
 	uint32_t is_last:1;
+#if QUADTREE_NODE_ENTITY_EXTENT == 1
+	rect_extent_t extent;
+#elif QUADTREE_NODE_ENTITY_EXTENT == 2
+	quadtree_quantized_extent_t extent;
+#endif
 }
 quadtree_node_entity_t;
 
 
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	/* next is the entity's following node entity, starting from its node_entity */
+	typedef struct quadtree_node_entity_link
+	{
+		uint32_t node_idx;
+		uint32_t next;
+	}
+	quadtree_node_entity_link_t;
+#endif
+
+
 typedef struct quadtree_node_entities
 {
 	uint32_t* next;
 	quadtree_node_entity_t* entities;
 	uint8_t* flags;
+#if QUADTREE_NODE_ENTITY_LINKS == 1
+	quadtree_node_entity_link_t* links;
+#endif
 }
 quadtree_node_entities_t;
 
@@ -220,11 +556,22 @@ struct quadtree
 	uint32_t merge_threshold;
 	uint32_t max_depth;
 	uint32_t dfs_length;
+	uint32_t thread_count;
 	float min_size;
+#if QUADTREE_LOOSE == 1
+	float looseness;
+#endif
+#if QUADTREE_BRANCH_ENTITIES == 1
+	float branch_entity_size;
+#endif
 
 	quadtree_node_t* nodes;
 	quadtree_node_entities_t node_entities;
 	quadtree_entity_t* entities;
+#if QUADTREE_ENTITY_SOA == 1
+	rect_extent_t* entity_extents;
+	quadtree_entity_data* entity_data;
+#endif
 #if QUADTREE_DEDUPE_COLLISIONS == 1
 	quadtree_ht_entry_t* ht_entries;
 #endif
@@ -232,6 +579,36 @@ struct quadtree
 	quadtree_node_removal_t* node_removals;
 	quadtree_insertion_t* insertions;
 	quadtree_reinsertion_t* reinsertions;
+	quadtree_thread_t* threads;
+	quadtree_handle_slot_t* handles;
+	quadtree_node_count_t* node_counts;
+#ifdef quadtree_node_aggregate
+	quadtree_node_aggregate* node_aggregates;
+#endif
+	quadtree_stale_node_t* stale_nodes;
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	uint32_t* node_parents;
+	quadtree_dirty_node_t* dirty_nodes;
+#endif
+#if QUADTREE_SCRATCH_ARENAS == 1
+	/* The arrays normalize last rebuilt the tree out of, which it rebuilds into next */
+	quadtree_node_t* spare_nodes;
+	quadtree_node_entities_t spare_node_entities;
+	quadtree_entity_t* spare_entities;
+#if QUADTREE_ENTITY_SOA == 1
+	rect_extent_t* spare_entity_extents;
+#endif
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	uint32_t* spare_node_parents;
+	quadtree_node_entity_t* gathered_entities;
+	uint8_t* gathered_flags;
+#endif
+	uint32_t* entity_map;
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	uint32_t* ht_buckets;
+#endif
+	quadtree_update_change_t* changes;
+#endif
 
 	uint32_t nodes_used;
 	uint32_t nodes_size;
@@ -259,17 +636,62 @@ struct quadtree
 	uint32_t reinsertions_used;
 	uint32_t reinsertions_size;
 
-	uint32_t query_tick;
+	uint32_t handles_used;
+	uint32_t handles_size;
+	uint32_t free_handle;
+
+	uint32_t node_counts_size;
+#ifdef quadtree_node_aggregate
+	uint32_t node_aggregates_size;
+#endif
+
+	uint32_t stale_nodes_used;
+	uint32_t stale_nodes_size;
+
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	uint32_t dirty_nodes_used;
+	uint32_t dirty_nodes_size;
+
+	uint32_t free_node;
+	uint32_t free_entity;
+	uint32_t node_entities_holes;
+#endif
+
+#if QUADTREE_SCRATCH_ARENAS == 1
+	uint32_t spare_nodes_size;
+	uint32_t spare_node_entities_size;
+	uint32_t spare_entities_size;
+#if QUADTREE_INCREMENTAL_NORMALIZE == 1
+	uint32_t gathered_size;
+#endif
+	uint32_t entity_map_size;
+#if QUADTREE_DEDUPE_COLLISIONS == 1
+	uint32_t ht_buckets_size;
+#endif
+	uint32_t changes_size;
+#endif
+
+	quadtree_query_scratch_t query_scratch;
 	uint8_t update_tick;
 
 	quadtree_normalized_t normalization;
 	bool merge_threshold_set;
+	/* Set by the first count, after which the sums are kept up to date */
+	bool node_sums_valid;
 
 	rect_extent_t rect_extent;
 	half_extent_t half_extent;
+
+	pool_t pool;
 };
 
 
+#if QUADTREE_SCRATCH_ARENAS == 1
+	/* Allocations made by all trees so far, for checking that a tick made none */
+	extern uint64_t quadtree_heap_calls;
+#endif
+
+
 extern void
 quadtree_init(
 	quadtree_t* qt
@@ -282,13 +704,22 @@ quadtree_free(
 	);
 
 
-extern void
+extern quadtree_handle_t
 quadtree_insert(
 	quadtree_t* qt,
 	const quadtree_entity_data* data
 	);
 
 
+extern void
+quadtree_bulk_load(
+	quadtree_t* qt,
+	const quadtree_entity_data* data,
+	uint32_t count,
+	quadtree_handle_t* handles
+	);
+
+
 extern void
 quadtree_remove(
 	quadtree_t* qt,
@@ -296,6 +727,28 @@ quadtree_remove(
 	);
 
 
+/* Stale handles are ignored, entities inserted since the last normalize are never added */
+extern void
+quadtree_remove_handle(
+	quadtree_t* qt,
+	quadtree_handle_t handle
+	);
+
+
+extern uint32_t
+quadtree_resolve(
+	const quadtree_t* qt,
+	quadtree_handle_t handle
+	);
+
+
+extern quadtree_handle_t
+quadtree_get_handle(
+	const quadtree_t* qt,
+	uint32_t entity_idx
+	);
+
+
 extern void
 quadtree_normalize(
 	quadtree_t* qt
@@ -310,6 +763,30 @@ quadtree_update(
 	);
 
 
+extern void
+quadtree_update_parallel(
+	quadtree_t* qt,
+	quadtree_update_fn_t update_fn,
+	void* user_data
+	);
+
+
+extern void
+quadtree_update_linear(
+	quadtree_t* qt,
+	quadtree_update_fn_t update_fn,
+	void* user_data
+	);
+
+
+extern void
+quadtree_update_batch(
+	quadtree_t* qt,
+	quadtree_update_batch_fn_t update_fn,
+	void* user_data
+	);
+
+
 extern void
 quadtree_query_rect(
 	quadtree_t* qt,
@@ -319,6 +796,44 @@ quadtree_query_rect(
 	);
 
 
+extern void
+quadtree_query_rect_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	rect_extent_t extent,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	);
+
+
+extern uint32_t
+quadtree_query_rect_collect(
+	quadtree_t* qt,
+	rect_extent_t extent,
+	quadtree_query_buffer_t* buffer
+	);
+
+
+extern void
+quadtree_query_rects(
+	quadtree_t* qt,
+	const rect_extent_t* extents,
+	uint32_t count,
+	quadtree_query_batch_fn_t query_fn,
+	void* user_data
+	);
+
+
+extern void
+quadtree_query_rects_parallel(
+	quadtree_t* qt,
+	const rect_extent_t* extents,
+	uint32_t count,
+	quadtree_query_batch_fn_t query_fn,
+	void* user_data
+	);
+
+
 extern void
 quadtree_query_circle(
 	quadtree_t* qt,
@@ -330,6 +845,61 @@ quadtree_query_circle(
 	);
 
 
+extern void
+quadtree_query_circle_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	float x,
+	float y,
+	float radius,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	);
+
+
+extern uint32_t
+quadtree_query_circle_collect(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float radius,
+	quadtree_query_buffer_t* buffer
+	);
+
+
+extern uint32_t
+quadtree_count_rect(
+	quadtree_t* qt,
+	rect_extent_t extent
+	);
+
+
+extern uint32_t
+quadtree_count_circle(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float radius
+	);
+
+
+#ifdef quadtree_node_aggregate
+	extern void
+	quadtree_query_aggregate(
+		quadtree_t* qt,
+		quadtree_aggregate_fn_t aggregate_fn,
+		quadtree_query_fn_t query_fn,
+		void* user_data
+		);
+
+
+	extern void
+	quadtree_invalidate_aggregates(
+		quadtree_t* qt
+		);
+#endif
+
+
 extern void
 quadtree_query_nodes_rect(
 	quadtree_t* qt,
@@ -358,6 +928,21 @@ quadtree_collide(
 	);
 
 
+/*
+ * Unless deterministic, pairs of entities lying in a single node are reported from the
+ * worker threads, each entity only ever from one of them. Pairs of entities lying in
+ * several nodes, and pairs between a branch's entities and the ones below it, are
+ * reported from the calling thread once the workers are done.
+ */
+extern void
+quadtree_collide_parallel(
+	quadtree_t* qt,
+	quadtree_collide_fn_t collide_fn,
+	void* user_data,
+	bool deterministic
+	);
+
+
 extern uint32_t
 quadtree_depth(
 	quadtree_t* qt
@@ -374,6 +959,17 @@ quadtree_nearest_rect(
 	);
 
 
+extern void
+quadtree_nearest_rect_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	rect_extent_t extent,
+	uint32_t max_results,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	);
+
+
 extern void
 quadtree_nearest_circle(
 	quadtree_t* qt,
@@ -386,6 +982,19 @@ quadtree_nearest_circle(
 	);
 
 
+extern void
+quadtree_nearest_circle_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	float x,
+	float y,
+	float max_distance,
+	uint32_t max_results,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	);
+
+
 extern void
 quadtree_raycast(
 	quadtree_t* qt,
@@ -398,6 +1007,42 @@ quadtree_raycast(
 	);
 
 
+extern void
+quadtree_raycast_concurrent(
+	const quadtree_t* qt,
+	quadtree_query_scratch_t* scratch,
+	float x,
+	float y,
+	float dx,
+	float dy,
+	quadtree_query_fn_t query_fn,
+	void* user_data
+	);
+
+
+extern uint32_t
+quadtree_raycast_collect(
+	quadtree_t* qt,
+	float x,
+	float y,
+	float dx,
+	float dy,
+	quadtree_query_buffer_t* buffer
+	);
+
+
+extern void
+quadtree_query_scratch_free(
+	quadtree_query_scratch_t* scratch
+	);
+
+
+extern void
+quadtree_query_buffer_free(
+	quadtree_query_buffer_t* buffer
+	);
+
+
 extern void
 quadtree_check(
 	quadtree_t* qt
@@ -10,6 +10,14 @@ entity_t;
 #define quadtree_entity_data entity_t
 #define quadtree_get_entity_data_rect_extent(entity) (entity).extent
 
+/* Compares the pairs of deterministic parallel collision to the serial ones every tick,
+ * with branch entities on, since their pairs are gathered apart from the leaves' */
+#define CHECK_COLLIDE_ORDER 0
+
+#if CHECK_COLLIDE_ORDER == 1
+	#define QUADTREE_BRANCH_ENTITIES 1
+#endif
+
 #include "window.c"
 #include "alloc/src/arena.c"
 #include "alloc/src/base.c"
@@ -27,6 +35,7 @@ entity_t;
 #include "alloc/src/tcb.c"
 #include "alloc/src/threads.c"
 #include "heap.c"
+#include "pool.c"
 #include "quadtree.c"
 
 #define ITER UINT32_C(400000)
@@ -42,6 +51,9 @@ entity_t;
 #define CANT_ESCAPE_AREA 1
 #define DO_THEM_QUERIES 1
 #define QUERIES_NUM 1000
+#define THREAD_COUNT 4
+#define DO_PARALLEL 0
+#define LOOSENESS 0.0625f
 
 static quadtree_t qt = {0};
 
@@ -56,12 +68,31 @@ typedef struct measurement_t
 measurement_t;
 
 static measurement_t measure_normalize;
+#if DO_PARALLEL == 1
+static measurement_t measure_collide_parallel;
+static measurement_t measure_update_parallel;
+#else
 static measurement_t measure_collide;
 static measurement_t measure_update;
+#endif
 static measurement_t measure_reinsertions;
 static measurement_t measure_node_removals;
 #if DO_THEM_QUERIES == 1
 static measurement_t measure_query;
+static measurement_t measure_query_parallel;
+#endif
+
+#if CHECK_COLLIDE_ORDER == 1
+typedef struct collide_order_t
+{
+	uint32_t* pairs;
+	uint32_t used;
+	uint32_t size;
+}
+collide_order_t;
+
+static collide_order_t collide_order_serial;
+static collide_order_t collide_order_parallel;
 #endif
 
 static float
@@ -249,10 +280,12 @@ static quadtree_status_t
 draw_node(
 	quadtree_t* qt,
 	const quadtree_node_info_t* info,
+	bool covered,
 	void* user_data
 	)
 {
 	(void) qt;
+	(void) covered;
 	(void) user_data;
 
 	rect_t rect = to_screen(half_to_rect_extent(info->extent));
@@ -278,18 +311,11 @@ draw_node(
 	return QUADTREE_STATUS_NOT_CHANGED;
 }
 
-static quadtree_status_t
+static void
 draw_entity(
-	quadtree_t* qt,
-	quadtree_entity_info_t info,
-	void* user_data
+	entity_t* entity
 	)
 {
-	(void) qt;
-	(void) user_data;
-
-	entity_t* entity = info.data;
-
 	rect_t rect = to_screen(entity->extent);
 
 	for(int x = rect.min_x; x <= rect.max_x; ++x)
@@ -303,8 +329,6 @@ draw_entity(
 		paint_pixel(rect.min_x, y, 0xFF000000);
 		paint_pixel(rect.max_x, y, 0xFF000000);
 	}
-
-	return QUADTREE_STATUS_NOT_CHANGED;
 }
 
 float
@@ -366,16 +390,68 @@ init(
 	}
 
 	start = get_time();
-	for(int i = 0; i < ITER; ++i)
-	{
-		quadtree_insert(&qt, rands + i);
-	}
+	quadtree_bulk_load(&qt, rands, ITER, NULL);
 	end = get_time();
-	printf("Queueing insertions took %.02lfms\n", end - start);
+	printf("Bulk loading took %.02lfms\n", end - start);
 
 	alloc_free(rands, ITER);
 }
 
+#if CHECK_COLLIDE_ORDER == 1
+
+static void
+record_collision(
+	const quadtree_t* qt,
+	quadtree_entity_info_t info_a,
+	quadtree_entity_info_t info_b,
+	void* user_data
+	)
+{
+	(void) qt;
+
+	collide_order_t* order = user_data;
+
+	if(order->used + 2 > order->size)
+	{
+		uint32_t new_size = ((order->used + 2) << 1) | 3;
+		order->pairs = alloc_remalloc(order->pairs, order->size, new_size);
+		order->size = new_size;
+	}
+
+	order->pairs[order->used++] = info_a.idx;
+	order->pairs[order->used++] = info_b.idx;
+}
+
+static void
+check_collide_order(
+	void
+	)
+{
+	collide_order_serial.used = 0;
+	quadtree_collide(&qt, record_collision, &collide_order_serial);
+
+	collide_order_parallel.used = 0;
+	quadtree_collide_parallel(&qt, record_collision, &collide_order_parallel, true);
+
+	if(collide_order_serial.used != collide_order_parallel.used)
+	{
+		printf("Parallel collision found %u pairs instead of %u\n",
+			collide_order_parallel.used >> 1, collide_order_serial.used >> 1);
+		exit(1);
+	}
+
+	for(uint32_t i = 0; i < collide_order_serial.used; ++i)
+	{
+		if(collide_order_serial.pairs[i] != collide_order_parallel.pairs[i])
+		{
+			printf("Parallel collision order differs from serial at pair %u\n", i >> 1);
+			exit(1);
+		}
+	}
+}
+
+#endif
+
 #if DO_THEM_QUERIES == 1
 
 static quadtree_status_t
@@ -392,6 +468,22 @@ query_ignore(
 	return QUADTREE_STATUS_NOT_CHANGED;
 }
 
+static quadtree_status_t
+query_batch_ignore(
+	quadtree_t* qt,
+	uint32_t query_idx,
+	quadtree_entity_info_t info,
+	void* user_data
+	)
+{
+	(void) qt;
+	(void) query_idx;
+	(void) info;
+	(void) user_data;
+
+	return QUADTREE_STATUS_NOT_CHANGED;
+}
+
 #endif
 
 static void
@@ -399,6 +491,20 @@ tick(
 	void
 	)
 {
+#if CHECK_COLLIDE_ORDER == 1
+	check_collide_order();
+#endif
+
+#if DO_PARALLEL == 1
+	start = get_time();
+	quadtree_collide_parallel(&qt, collide_entities, NULL, true);
+	end = get_time();
+	time_elapsed = measure(&measure_collide_parallel, end - start);
+	if(time_elapsed)
+	{
+		printf("\nParallel collide: %.02lfms\n", time_elapsed);
+	}
+#else
 	start = get_time();
 	quadtree_collide(&qt, collide_entities, NULL);
 	end = get_time();
@@ -407,7 +513,18 @@ tick(
 	{
 		printf("\nCollide: %.02lfms\n", time_elapsed);
 	}
+#endif
 
+#if DO_PARALLEL == 1
+	start = get_time();
+	quadtree_update_parallel(&qt, update_entity, NULL);
+	end = get_time();
+	time_elapsed = measure(&measure_update_parallel, end - start);
+	if(time_elapsed)
+	{
+		printf("Parallel update: %.02lfms\n", time_elapsed);
+	}
+#else
 	start = get_time();
 	quadtree_update(&qt, update_entity, NULL);
 	end = get_time();
@@ -416,6 +533,7 @@ tick(
 	{
 		printf("Update: %.02lfms\n", time_elapsed);
 	}
+#endif
 
 	time_elapsed = measure(&measure_reinsertions, qt.reinsertions_used);
 	if(time_elapsed)
@@ -445,13 +563,14 @@ tick(
 	start = get_time();
 	for(int i = 1; i <= QUERIES_NUM; ++i)
 	{
+		rect_extent_t entity_extent = quadtree_get_entity_data(&qt, i)->extent;
 		rect_extent_t extent =
 		(rect_extent_t)
 		{
-			.min_x = qt.entities[i].data.extent.min_x - 1920.0f * 0.5f,
-			.max_x = qt.entities[i].data.extent.max_x + 1920.0f * 0.5f,
-			.min_y = qt.entities[i].data.extent.min_y - 1080.0f * 0.5f,
-			.max_y = qt.entities[i].data.extent.max_y + 1080.0f * 0.5f
+			.min_x = entity_extent.min_x - 1920.0f * 0.5f,
+			.max_x = entity_extent.max_x + 1920.0f * 0.5f,
+			.min_y = entity_extent.min_y - 1080.0f * 0.5f,
+			.max_y = entity_extent.max_y + 1080.0f * 0.5f
 		};
 		quadtree_query_rect(&qt, extent, query_ignore, NULL);
 	}
@@ -461,6 +580,28 @@ tick(
 	{
 		printf("1k Queries: %.02lfms\n", time_elapsed);
 	}
+
+	start = get_time();
+	static rect_extent_t extents[QUERIES_NUM];
+	for(int i = 1; i <= QUERIES_NUM; ++i)
+	{
+		rect_extent_t extent = quadtree_get_entity_data(&qt, i)->extent;
+		extents[i - 1] =
+		(rect_extent_t)
+		{
+			.min_x = extent.min_x - 1920.0f * 0.5f,
+			.max_x = extent.max_x + 1920.0f * 0.5f,
+			.min_y = extent.min_y - 1080.0f * 0.5f,
+			.max_y = extent.max_y + 1080.0f * 0.5f
+		};
+	}
+	quadtree_query_rects_parallel(&qt, extents, QUERIES_NUM, query_batch_ignore, NULL);
+	end = get_time();
+	time_elapsed = measure(&measure_query_parallel, end - start);
+	if(time_elapsed)
+	{
+		printf("1k Parallel batched queries: %.02lfms\n", time_elapsed);
+	}
 #endif
 }
 
@@ -492,11 +633,20 @@ main()
 	};
 
 	qt.min_size = MIN_SIZE;
+	qt.thread_count = THREAD_COUNT;
+#if QUADTREE_LOOSE == 1
+	qt.looseness = LOOSENESS;
+#endif
 
 	quadtree_init(&qt);
 
 	init();
 
+	quadtree_query_buffer_t view_buffer =
+	{
+		.collect_data = true
+	};
+
 	while(1)
 	{
 		if(draw_start() != DRAW_STATE_OK)
@@ -509,13 +659,22 @@ main()
 		rect_extent_t rect_view = half_to_rect_extent(view);
 
 		quadtree_query_nodes_rect(&qt, rect_view, draw_node, NULL);
-		quadtree_query_rect(&qt, rect_view, draw_entity, NULL);
+		uint32_t count = quadtree_query_rect_collect(&qt, rect_view, &view_buffer);
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			draw_entity(view_buffer.data[i]);
+		}
 
 		draw_end();
 	}
 
 	draw_free();
 
+#if CHECK_COLLIDE_ORDER == 1
+	alloc_free(collide_order_parallel.pairs, collide_order_parallel.size);
+	alloc_free(collide_order_serial.pairs, collide_order_serial.size);
+#endif
+	quadtree_query_buffer_free(&view_buffer);
 	quadtree_free(&qt);
 
 	return 0;